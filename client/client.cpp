@@ -1,7 +1,9 @@
 #include "client.hpp"
+#include "core/instrument.hpp"
 #include "packets/exchange.hpp"
 #include "packets/login.hpp"
 #include "packets/wallet.hpp"
+#include "pipeline.hpp"
 #include "precompiled.hpp"
 
 namespace exchange
@@ -18,6 +20,28 @@ namespace exchange
     {
         m_socket.connect(
             boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(std::string(address)), port));
+
+        Packet::on_push = [](nlohmann::json const& packet) {
+            try
+            {
+                auto const report = packet["payload"].get<packets::ExecutionReport>();
+                auto const instrument = core::find_instrument(report.instrument_id);
+                if (!instrument)
+                {
+                    return;
+                }
+
+                std::cout << std::format("\nRequest (id: {}) was filled: {} {} at {}, {} remaining\n",
+                                         report.request_id, report.request_type == 0 ? "bought" : "sold",
+                                         core::Decimal(report.amount, instrument->amount_scale).to_string(),
+                                         core::Decimal(report.price, instrument->price_scale).to_string(),
+                                         core::Decimal(report.remaining, instrument->amount_scale).to_string())
+                          << std::endl;
+            }
+            catch (nlohmann::json::exception e)
+            {
+            }
+        };
     }
 
     auto Client::run() -> void
@@ -27,6 +51,16 @@ namespace exchange
 
         while (running)
         {
+            // A response out of step with the requests closes the connection, nothing after it can be trusted
+            if (!m_socket.is_open())
+            {
+                std::cout << "\nConnection to the server was lost\n" << std::endl;
+                return;
+            }
+
+            // Fills reported while the menu was waiting for input
+            Packet::poll(m_socket);
+
             switch (menu_type)
             {
                 case MenuType::Login: {
@@ -132,7 +166,8 @@ namespace exchange
                     std::cout << "Account Menu:\n"
                                  "1) My Wallet\n"
                                  "2) Make Request\n"
-                                 "3) Logout\n"
+                                 "3) Cancel Requests\n"
+                                 "4) Logout\n"
                               << std::endl;
 
                     uint16_t menu_option;
@@ -161,7 +196,9 @@ namespace exchange
 
                             for (auto const& wallet_info : wallet_infos)
                             {
-                                std::cout << std::format("{:10} {:8}", wallet_info.currency, wallet_info.amount)
+                                auto const currency = core::find_currency(wallet_info.currency);
+                                core::Decimal const amount(wallet_info.amount, currency ? currency->scale : 0);
+                                std::cout << std::format("{:10} {:8}", wallet_info.currency, amount.to_string())
                                           << std::endl;
                             }
 
@@ -169,13 +206,36 @@ namespace exchange
                             break;
                         }
                         case 2: {
-                            float amount;
+                            auto const& instrument = *core::find_instrument("USD/RUB");
+
+                            std::string amount_text;
                             std::cout << "Type amount: ";
-                            std::cin >> amount;
+                            std::cin >> amount_text;
 
-                            float price;
+                            auto const amount = core::Decimal::parse(amount_text, instrument.amount_scale);
+                            if (!amount || amount->units() <= 0)
+                            {
+                                std::cout << "\nInvalid amount\n" << std::endl;
+                                break;
+                            }
+
+                            std::string price_text;
                             std::cout << "Type price (per unit): ";
-                            std::cin >> price;
+                            std::cin >> price_text;
+
+                            auto const price = core::Decimal::parse(price_text, instrument.price_scale);
+                            if (!price || price->units() <= 0)
+                            {
+                                std::cout << "\nInvalid price\n" << std::endl;
+                                break;
+                            }
+
+                            auto const notional = core::notional(instrument, amount->units(), price->units());
+                            if (!notional)
+                            {
+                                std::cout << "\nThe request is too large\n" << std::endl;
+                                break;
+                            }
 
                             uint32_t request_type;
                             while (true)
@@ -189,8 +249,11 @@ namespace exchange
                                 }
                             }
 
+                            core::Decimal const total(notional.value(), instrument.quote_scale);
+
                             std::cout << std::format("Request to {} {} USD for {} ({}) RUB",
-                                                     request_type == 0 ? "buy" : "sell", amount, price, amount * price)
+                                                     request_type == 0 ? "buy" : "sell", amount->to_string(),
+                                                     price->to_string(), total.to_string())
                                       << std::endl;
 
                             uint16_t confirm;
@@ -202,9 +265,11 @@ namespace exchange
                             }
 
                             bool successful;
+                            uint64_t request_id;
                             {
-                                auto packet = std::make_unique<packets::MakeRequestPacket>("USD/RUB", amount, price,
-                                                                                           request_type, successful);
+                                auto packet = std::make_unique<packets::MakeRequestPacket>(
+                                    instrument.id, amount->units(), price->units(), request_type, successful,
+                                    request_id);
                                 if (!packet->process(m_socket))
                                 {
                                     std::cout << "\nUnknown response from server\n" << std::endl;
@@ -217,10 +282,52 @@ namespace exchange
                                 break;
                             }
 
-                            std::cout << "\nRequest was created\n" << std::endl;
+                            std::cout << std::format("\nRequest (id: {}) was created\n", request_id) << std::endl;
                             break;
                         }
                         case 3: {
+                            std::vector<std::pair<uint64_t, bool>> cancels;
+                            while (true)
+                            {
+                                uint64_t request_id;
+                                std::cout << "Type request id (0 to finish): ";
+                                std::cin >> request_id;
+
+                                if (request_id == 0)
+                                {
+                                    break;
+                                }
+                                cancels.emplace_back(request_id, false);
+                            }
+                            if (cancels.empty())
+                            {
+                                break;
+                            }
+
+                            // Every cancel is sent at once, the answers are matched to them by id
+                            Pipeline pipeline(m_socket);
+                            for (auto& [request_id, successful] : cancels)
+                            {
+                                pipeline.submit(std::make_unique<packets::CancelRequestPacket>(
+                                    core::find_instrument("USD/RUB")->id, request_id, successful));
+                            }
+                            if (!pipeline.complete())
+                            {
+                                std::cout << "\nUnknown response from server\n" << std::endl;
+                                break;
+                            }
+
+                            std::cout << std::endl;
+                            for (auto const& [request_id, successful] : cancels)
+                            {
+                                std::cout << std::format("Request (id: {}) {}", request_id,
+                                                         successful ? "was cancelled" : "was not found")
+                                          << std::endl;
+                            }
+                            std::cout << std::endl;
+                            break;
+                        }
+                        case 4: {
                             auto packet = std::make_unique<packets::LogoutPacket>();
                             if (!packet->process(m_socket))
                             {
@@ -9,43 +9,112 @@ namespace exchange
 
     auto Packet::process(boost::asio::ip::tcp::socket& socket) -> bool
     {
+        boost::asio::write(socket, boost::asio::buffer(this->encode(std::nullopt)));
+
+        auto const packet = Packet::receive(socket);
+        return packet && this->decode(packet.value());
+    }
+
+    auto Packet::encode(std::optional<uint64_t> const request_id) -> std::vector<uint8_t>
+    {
+        nlohmann::json packet;
+        packet["type"] = static_cast<uint16_t>(m_message_type);
+        if (request_id)
         {
-            nlohmann::json packet;
-            packet["type"] = static_cast<uint16_t>(m_message_type);
+            packet["id"] = request_id.value();
+        }
 
-            nlohmann::json payload;
-            this->send(payload);
+        nlohmann::json payload;
+        this->send(payload);
 
-            packet["payload"] = payload;
+        packet["payload"] = payload;
 
-            std::string const message = packet.dump();
-            boost::asio::write(socket, boost::asio::buffer(message));
-        }
+        std::vector<uint8_t> buffer;
+        core::frame(packet, buffer);
+        return buffer;
+    }
 
+    auto Packet::decode(nlohmann::json const& packet) -> bool
+    {
+        try
         {
-            boost::asio::streambuf buffer;
-            boost::asio::read_until(socket, buffer, "\0");
-            std::istream is(&buffer);
-
-            std::string const message(std::istreambuf_iterator<char>(is), {});
+            auto type = static_cast<core::RequestMessageType>(packet.at("type").get<uint16_t>());
 
-            try
+            if (type != m_message_type)
             {
-                auto packet = nlohmann::json::parse(message);
-                auto type = static_cast<core::RequestMessageType>(packet["type"].get<uint16_t>());
+                return false;
+            }
 
-                if (type != m_message_type)
-                {
-                    return false;
-                }
+            this->accept(packet.at("payload"));
+            return true;
+        }
+        catch (nlohmann::json::exception e)
+        {
+            return false;
+        }
+    }
 
-                this->accept(packet["payload"]);
-                return true;
+    auto Packet::receive(boost::asio::ip::tcp::socket& socket) -> std::optional<nlohmann::json>
+    {
+        while (true)
+        {
+            auto packet = Packet::read(socket);
+            if (!packet || !Packet::pushed(packet.value()))
+            {
+                return packet;
             }
-            catch (nlohmann::json::exception e)
+
+            if (on_push)
             {
-                return false;
+                on_push(packet.value());
+            }
+        }
+    }
+
+    auto Packet::poll(boost::asio::ip::tcp::socket& socket) -> void
+    {
+        // The server writes whole messages, so one that has started to arrive is read to its end
+        while (socket.is_open() && socket.available() > 0)
+        {
+            auto const packet = Packet::read(socket);
+            if (packet && Packet::pushed(packet.value()) && on_push)
+            {
+                on_push(packet.value());
             }
         }
     }
+
+    auto Packet::pushed(nlohmann::json const& packet) -> bool
+    {
+        return packet.is_object() &&
+               packet.value("type", 0) == static_cast<uint16_t>(core::RequestMessageType::ExecutionReport);
+    }
+
+    auto Packet::read(boost::asio::ip::tcp::socket& socket) -> std::optional<nlohmann::json>
+    {
+        std::array<uint8_t, core::frame_header_size> header;
+        boost::asio::read(socket, boost::asio::buffer(header));
+
+        size_t offset = 0;
+        uint32_t const size = core::get_integer<uint32_t>(header, offset).value();
+        if (size > core::max_frame_size)
+        {
+            // The body is left unread, so nothing after it can be framed
+            boost::system::error_code error;
+            socket.close(error);
+            return std::nullopt;
+        }
+
+        std::string message(size, '\0');
+        boost::asio::read(socket, boost::asio::buffer(message));
+
+        try
+        {
+            return nlohmann::json::parse(message);
+        }
+        catch (nlohmann::json::exception e)
+        {
+            return std::nullopt;
+        }
+    }
 } // namespace exchange
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/common.hpp"
+#include "core/framing.hpp"
 #include "core/json.hpp"
 
 namespace exchange
@@ -10,8 +11,27 @@ namespace exchange
       public:
         Packet(core::RequestMessageType const message_type);
 
+        virtual ~Packet() = default;
+
+        // Sends the request and waits for its response
         auto process(boost::asio::ip::tcp::socket& socket) -> bool;
 
+        // The framed request, tagged with an id when several are in flight
+        auto encode(std::optional<uint64_t> const request_id) -> std::vector<uint8_t>;
+
+        // Takes the response to this request, false if it is of another type
+        auto decode(nlohmann::json const& packet) -> bool;
+
+        // The next response from the server, nullopt if it is oversized or not json. An oversized one closes the
+        // socket, as its body is never read. Pushed messages read on the way are handed to on_push
+        static auto receive(boost::asio::ip::tcp::socket& socket) -> std::optional<nlohmann::json>;
+
+        // Hands pushed messages that have already arrived to on_push, without waiting for more
+        static auto poll(boost::asio::ip::tcp::socket& socket) -> void;
+
+        // Messages the server sends on its own, such as execution reports
+        static inline std::function<void(nlohmann::json const& packet)> on_push;
+
       protected:
         virtual auto accept(nlohmann::json const& payload) -> void = 0;
 
@@ -19,5 +39,9 @@ namespace exchange
 
       private:
         core::RequestMessageType m_message_type;
+
+        static auto read(boost::asio::ip::tcp::socket& socket) -> std::optional<nlohmann::json>;
+
+        static auto pushed(nlohmann::json const& packet) -> bool;
     };
 } // namespace exchange
\ No newline at end of file
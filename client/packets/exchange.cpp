@@ -3,10 +3,11 @@
 
 namespace exchange::packets
 {
-    MakeRequestPacket::MakeRequestPacket(std::string_view const currency, float const amount,
-                                         float const price, uint32_t const request_type, bool& successful)
-        : Packet(core::RequestMessageType::MakeRequest), m_currency(currency), m_amount(amount),
-          m_price(price), m_request_type(request_type), m_successful(&successful)
+    MakeRequestPacket::MakeRequestPacket(core::InstrumentId const instrument_id, int64_t const amount,
+                                         int64_t const price, uint32_t const request_type, bool& successful,
+                                         uint64_t& request_id)
+        : Packet(core::RequestMessageType::MakeRequest), m_instrument_id(instrument_id), m_amount(amount),
+          m_price(price), m_request_type(request_type), m_successful(&successful), m_request_id(&request_id)
     {
     }
 
@@ -19,14 +20,40 @@ namespace exchange::packets
             return;
         }
 
+        *m_request_id = payload["request_id"].get<uint64_t>();
         *m_successful = true;
     }
 
     auto MakeRequestPacket::send(nlohmann::json& payload) -> void
     {
-        payload["currency"] = m_currency;
+        payload["instrument_id"] = m_instrument_id;
         payload["amount"] = m_amount;
         payload["price"] = m_price;
         payload["request_type"] = m_request_type;
     }
+
+    CancelRequestPacket::CancelRequestPacket(core::InstrumentId const instrument_id, uint64_t const request_id,
+                                             bool& successful)
+        : Packet(core::RequestMessageType::CancelRequest), m_instrument_id(instrument_id), m_request_id(request_id),
+          m_successful(&successful)
+    {
+    }
+
+    auto CancelRequestPacket::accept(nlohmann::json const& payload) -> void
+    {
+        auto error_code = static_cast<core::ErrorCode>(payload["error_code"].get<uint16_t>());
+        if (error_code != core::ErrorCode::Success)
+        {
+            *m_successful = false;
+            return;
+        }
+
+        *m_successful = true;
+    }
+
+    auto CancelRequestPacket::send(nlohmann::json& payload) -> void
+    {
+        payload["instrument_id"] = m_instrument_id;
+        payload["request_id"] = m_request_id;
+    }
 } // namespace exchange::packets
\ No newline at end of file
@@ -1,14 +1,29 @@
 #pragma once
 
+#include "core/instrument.hpp"
 #include "packet.hpp"
 
 namespace exchange::packets
 {
+    // Pushed by the server whenever a request of the user is filled
+    struct ExecutionReport
+    {
+        core::InstrumentId instrument_id;
+        uint64_t request_id;
+        uint32_t request_type;
+        int64_t amount;
+        int64_t price;
+        int64_t remaining;
+    };
+
+    NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(exchange::packets::ExecutionReport, instrument_id, request_id, request_type,
+                                       amount, price, remaining)
+
     class MakeRequestPacket : public Packet
     {
       public:
-        MakeRequestPacket(std::string_view const currency, float const amount,
-                          float const price, uint32_t const request_type, bool& successful);
+        MakeRequestPacket(core::InstrumentId const instrument_id, int64_t const amount,
+                          int64_t const price, uint32_t const request_type, bool& successful, uint64_t& request_id);
 
       protected:
         auto accept(nlohmann::json const& payload) -> void override;
@@ -16,11 +31,29 @@ namespace exchange::packets
         auto send(nlohmann::json& payload) -> void override;
 
       private:
-        std::string_view m_currency;
-        float m_amount;
-        float m_price;
+        core::InstrumentId m_instrument_id;
+        int64_t m_amount;
+        int64_t m_price;
         uint32_t m_request_type;
 
+        bool* m_successful;
+        uint64_t* m_request_id;
+    };
+
+    class CancelRequestPacket : public Packet
+    {
+      public:
+        CancelRequestPacket(core::InstrumentId const instrument_id, uint64_t const request_id, bool& successful);
+
+      protected:
+        auto accept(nlohmann::json const& payload) -> void override;
+
+        auto send(nlohmann::json& payload) -> void override;
+
+      private:
+        core::InstrumentId m_instrument_id;
+        uint64_t m_request_id;
+
         bool* m_successful;
     };
 } // namespace exchange::packets
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace exchange::packets
     {
         uint64_t id;
         std::string currency;
-        float amount;
+        int64_t amount;
     };
 
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(exchange::packets::WalletInfo, id, currency, amount)
@@ -0,0 +1,54 @@
+#include "pipeline.hpp"
+#include "precompiled.hpp"
+
+namespace exchange
+{
+    Pipeline::Pipeline(boost::asio::ip::tcp::socket& socket) : m_socket(&socket), m_next_id(0)
+    {
+    }
+
+    auto Pipeline::submit(std::unique_ptr<Packet> packet) -> void
+    {
+        auto const request_id = m_next_id++;
+
+        auto const request = packet->encode(request_id);
+        m_requests.insert(m_requests.end(), request.begin(), request.end());
+        m_in_flight[request_id] = std::move(packet);
+    }
+
+    auto Pipeline::complete() -> bool
+    {
+        boost::asio::write(*m_socket, boost::asio::buffer(m_requests));
+        m_requests.clear();
+
+        bool successful = true;
+        while (!m_in_flight.empty())
+        {
+            auto const packet = Packet::receive(*m_socket);
+            if (!packet || !packet->contains("id") || !packet->at("id").is_number_unsigned())
+            {
+                return this->abort();
+            }
+
+            auto const it = m_in_flight.find(packet->at("id").get<uint64_t>());
+            if (it == m_in_flight.end())
+            {
+                return this->abort();
+            }
+
+            successful = it->second->decode(packet.value()) && successful;
+            m_in_flight.erase(it);
+        }
+        return successful;
+    }
+
+    auto Pipeline::abort() -> bool
+    {
+        // A response that cannot be matched leaves the rest of the stream unaccounted for
+        m_in_flight.clear();
+
+        boost::system::error_code error;
+        m_socket->close(error);
+        return false;
+    }
+} // namespace exchange
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "packet.hpp"
+
+namespace exchange
+{
+    // Keeps several requests in flight on one connection, responses are matched by the id each request is tagged
+    // with, so they may arrive in any order
+    class Pipeline
+    {
+      public:
+        Pipeline(boost::asio::ip::tcp::socket& socket);
+
+        // The request is sent with the next batch
+        auto submit(std::unique_ptr<Packet> packet) -> void;
+
+        // Sends every submitted request at once and waits for all responses, false if any of them failed.
+        // A response that matches no request closes the socket, the responses after it cannot be told apart
+        auto complete() -> bool;
+
+      private:
+        boost::asio::ip::tcp::socket* m_socket;
+        uint64_t m_next_id;
+        std::vector<uint8_t> m_requests;
+        std::unordered_map<uint64_t, std::unique_ptr<Packet>> m_in_flight;
+
+        auto abort() -> bool;
+    };
+} // namespace exchange
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <boost/crc.hpp>
+
+namespace core
+{
+    // Integers are stored little-endian whatever the host is
+    template <typename Type>
+    auto put_integer(std::vector<uint8_t>& buffer, Type const value) -> void
+    {
+        auto const bits = static_cast<std::make_unsigned_t<Type>>(value);
+        for (size_t i = 0; i < sizeof(Type); ++i)
+        {
+            buffer.emplace_back(static_cast<uint8_t>(bits >> (i * 8)));
+        }
+    }
+
+    // Overwrites bytes already in the buffer, for a length known only once what follows it is written
+    template <typename Type>
+    auto set_integer(std::span<uint8_t> const buffer, size_t const offset, Type const value) -> void
+    {
+        auto const bits = static_cast<std::make_unsigned_t<Type>>(value);
+        for (size_t i = 0; i < sizeof(Type); ++i)
+        {
+            buffer[offset + i] = static_cast<uint8_t>(bits >> (i * 8));
+        }
+    }
+
+    template <typename Type>
+    auto get_integer(std::span<uint8_t const> const buffer, size_t& offset) -> std::optional<Type>
+    {
+        if (offset + sizeof(Type) > buffer.size())
+        {
+            return std::nullopt;
+        }
+
+        std::make_unsigned_t<Type> bits = 0;
+        for (size_t i = 0; i < sizeof(Type); ++i)
+        {
+            bits |= static_cast<std::make_unsigned_t<Type>>(buffer[offset + i]) << (i * 8);
+        }
+        offset += sizeof(Type);
+        return static_cast<Type>(bits);
+    }
+
+    inline auto crc32(std::span<uint8_t const> const bytes) -> uint32_t
+    {
+        boost::crc_32_type crc;
+        crc.process_bytes(bytes.data(), bytes.size());
+        return crc.checksum();
+    }
+} // namespace core
@@ -0,0 +1,58 @@
+#pragma once
+
+namespace core
+{
+    // Byte buffers shared by all connections. A released buffer keeps its capacity for the next user, so steady
+    // traffic stops allocating, while a buffer grown past max_capacity by one large message is freed instead
+    class BufferPool
+    {
+      public:
+        BufferPool(size_t const max_buffers = 1024, size_t const max_capacity = 64 * 1024)
+            : m_max_buffers(max_buffers), m_max_capacity(max_capacity)
+        {
+        }
+
+        // An empty buffer, with the capacity of whichever one was released last
+        auto acquire() -> std::vector<uint8_t>
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_buffers.empty())
+            {
+                return {};
+            }
+
+            auto buffer = std::move(m_buffers.back());
+            m_buffers.pop_back();
+            return buffer;
+        }
+
+        auto release(std::vector<uint8_t>&& buffer) -> void
+        {
+            if (buffer.capacity() == 0 || buffer.capacity() > m_max_capacity)
+            {
+                return;
+            }
+            buffer.clear();
+
+            std::lock_guard lock(m_mutex);
+            if (m_buffers.size() < m_max_buffers)
+            {
+                m_buffers.emplace_back(std::move(buffer));
+            }
+        }
+
+        // Buffers waiting to be reused
+        auto size() const -> size_t
+        {
+            std::lock_guard lock(m_mutex);
+            return m_buffers.size();
+        }
+
+      private:
+        size_t m_max_buffers;
+        size_t m_max_capacity;
+
+        mutable std::mutex m_mutex;
+        std::vector<std::vector<uint8_t>> m_buffers;
+    };
+} // namespace core
\ No newline at end of file
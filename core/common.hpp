@@ -10,7 +10,11 @@ namespace core
         Logout = 1 << 3,
         Register = 1 << 4,
         WalletList = 1 << 5,
-        MakeRequest = 1 << 6
+        MakeRequest = 1 << 6,
+        CancelRequest = 1 << 7,
+
+        // Pushed by the server when a request of the user is filled
+        ExecutionReport = 1 << 8
     };
 
     enum class ErrorCode : uint16_t
@@ -21,6 +25,7 @@ namespace core
         AuthExists = 3,
         DBFailed = 4,
         Restricted = 5,
-        ValidationError = 6 
+        ValidationError = 6,
+        RequestNotFound = 7
     };
 } // namespace core
\ No newline at end of file
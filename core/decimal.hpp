@@ -0,0 +1,117 @@
+#pragma once
+
+namespace core
+{
+    constexpr auto pow10(uint8_t const exponent) -> int64_t
+    {
+        int64_t result = 1;
+        for (uint8_t i = 0; i < exponent; ++i)
+        {
+            result *= 10;
+        }
+        return result;
+    }
+
+    // Product of two integers, or nothing when it does not fit in int64_t
+    constexpr auto checked_multiply(int64_t const left, int64_t const right) -> std::optional<int64_t>
+    {
+        constexpr int64_t max = std::numeric_limits<int64_t>::max();
+        constexpr int64_t min = std::numeric_limits<int64_t>::min();
+        bool const overflows = left > 0 ? (right > 0 ? left > max / right : right < min / left)
+                                        : (right > 0 ? left < min / right : left != 0 && right < max / left);
+        if (overflows)
+        {
+            return std::nullopt;
+        }
+        return left * right;
+    }
+
+    // Fixed-point decimal kept as an integer count of 10^-scale units
+    class Decimal
+    {
+      public:
+        constexpr Decimal(int64_t const units, uint8_t const scale) : m_units(units), m_scale(scale)
+        {
+        }
+
+        static auto parse(std::string_view const text, uint8_t const scale) -> std::optional<Decimal>
+        {
+            std::string_view digits = text;
+            bool const negative = !digits.empty() && digits.front() == '-';
+            if (negative)
+            {
+                digits.remove_prefix(1);
+            }
+
+            auto const point = digits.find('.');
+            std::string_view const integer_part = digits.substr(0, point);
+            std::string_view const fraction_part =
+                point == std::string_view::npos ? std::string_view() : digits.substr(point + 1);
+
+            if ((integer_part.empty() && fraction_part.empty()) || fraction_part.size() > scale ||
+                (point != std::string_view::npos && fraction_part.empty()))
+            {
+                return std::nullopt;
+            }
+
+            int64_t units = 0;
+            for (char const c : integer_part)
+            {
+                if (c < '0' || c > '9' || units > (std::numeric_limits<int64_t>::max() - 9) / 10)
+                {
+                    return std::nullopt;
+                }
+                units = units * 10 + (c - '0');
+            }
+
+            int64_t fraction = 0;
+            for (char const c : fraction_part)
+            {
+                if (c < '0' || c > '9')
+                {
+                    return std::nullopt;
+                }
+                fraction = fraction * 10 + (c - '0');
+            }
+            fraction *= pow10(scale - static_cast<uint8_t>(fraction_part.size()));
+
+            if (units > (std::numeric_limits<int64_t>::max() - fraction) / pow10(scale))
+            {
+                return std::nullopt;
+            }
+            units = units * pow10(scale) + fraction;
+            return Decimal(negative ? -units : units, scale);
+        }
+
+        constexpr auto units() const -> int64_t
+        {
+            return m_units;
+        }
+
+        constexpr auto scale() const -> uint8_t
+        {
+            return m_scale;
+        }
+
+        auto to_string() const -> std::string
+        {
+            uint64_t const magnitude = m_units < 0 ? 0 - static_cast<uint64_t>(m_units) : m_units;
+            uint64_t const factor = pow10(m_scale);
+
+            std::string result = m_units < 0 ? "-" : "";
+            result += std::to_string(magnitude / factor);
+            if (m_scale > 0)
+            {
+                std::string const fraction = std::to_string(magnitude % factor);
+                result += '.';
+                result.append(m_scale - fraction.size(), '0');
+                result += fraction;
+            }
+            return result;
+        }
+
+      private:
+        int64_t m_units;
+        uint8_t m_scale;
+    };
+} // namespace core
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "binary.hpp"
+#include "json.hpp"
+
+namespace core
+{
+    // Every message on the stream is preceded by its length, a little-endian uint32
+    constexpr size_t frame_header_size = sizeof(uint32_t);
+
+    // A peer announcing more than this is dropped instead of being buffered for
+    constexpr uint32_t max_frame_size = 16 * 1024 * 1024;
+
+    inline auto frame(std::string_view const message) -> std::vector<uint8_t>
+    {
+        std::vector<uint8_t> buffer;
+        buffer.reserve(frame_header_size + message.size());
+        put_integer(buffer, static_cast<uint32_t>(message.size()));
+        buffer.insert(buffer.end(), message.begin(), message.end());
+        return buffer;
+    }
+
+    // Stream buffer appending whatever is written through it to a frame
+    class FrameStreamBuffer : public std::streambuf
+    {
+      public:
+        FrameStreamBuffer(std::vector<uint8_t>& buffer) : m_buffer(&buffer)
+        {
+        }
+
+      protected:
+        auto overflow(int_type const c) -> int_type override
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                m_buffer->emplace_back(static_cast<uint8_t>(traits_type::to_char_type(c)));
+            }
+            return traits_type::not_eof(c);
+        }
+
+        auto xsputn(char const* s, std::streamsize const count) -> std::streamsize override
+        {
+            m_buffer->insert(m_buffer->end(), s, s + count);
+            return count;
+        }
+
+      private:
+        std::vector<uint8_t>* m_buffer;
+    };
+
+    // Appends the framed message to the buffer, dumped straight into it with no intermediate string. The length
+    // is filled in once the message is written
+    inline auto frame(nlohmann::json const& message, std::vector<uint8_t>& buffer) -> void
+    {
+        size_t const header = buffer.size();
+        put_integer(buffer, uint32_t{0});
+
+        FrameStreamBuffer stream_buffer(buffer);
+        std::ostream stream(&stream_buffer);
+        stream << message;
+
+        set_integer(std::span(buffer), header, static_cast<uint32_t>(buffer.size() - header - frame_header_size));
+    }
+
+    // Reassembles messages from reads of any size: one read may carry several messages or a part of one
+    class FrameReader
+    {
+      public:
+        // Space for the next read at the end of the buffered bytes
+        auto prepare(size_t const size) -> std::span<uint8_t>
+        {
+            // Messages already taken are dropped only now, their bytes stay valid until the next read
+            if (m_begin > 0)
+            {
+                std::copy(m_buffer.begin() + m_begin, m_buffer.begin() + m_end, m_buffer.begin());
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+
+            if (m_buffer.size() < m_end + size)
+            {
+                m_buffer.resize(m_end + size);
+            }
+            return std::span(m_buffer.data() + m_end, size);
+        }
+
+        auto commit(size_t const size) -> void
+        {
+            m_end += size;
+        }
+
+        // The next complete message, nullopt until its last byte has been read
+        auto next() -> std::optional<std::span<uint8_t const>>
+        {
+            std::span<uint8_t const> const buffered(m_buffer.data() + m_begin, m_end - m_begin);
+
+            size_t offset = 0;
+            auto const size = get_integer<uint32_t>(buffered, offset);
+            if (!size)
+            {
+                return std::nullopt;
+            }
+
+            if (size.value() > max_frame_size)
+            {
+                m_failed = true;
+                return std::nullopt;
+            }
+
+            if (buffered.size() < frame_header_size + size.value())
+            {
+                return std::nullopt;
+            }
+
+            m_begin += frame_header_size + size.value();
+            return buffered.subspan(frame_header_size, size.value());
+        }
+
+        // Nothing is buffered, not even a part of a message
+        auto empty() const -> bool
+        {
+            return m_begin == m_end;
+        }
+
+        // Hands the storage over while nothing is buffered, so an idle connection holds no memory
+        auto release() -> std::vector<uint8_t>
+        {
+            if (!this->empty())
+            {
+                return {};
+            }
+
+            m_begin = 0;
+            m_end = 0;
+            return std::exchange(m_buffer, {});
+        }
+
+        // Storage for the next reads, taken only while the reader has none
+        auto reset(std::vector<uint8_t>&& buffer) -> void
+        {
+            if (this->empty() && m_buffer.capacity() == 0)
+            {
+                m_buffer = std::move(buffer);
+                m_buffer.clear();
+                m_begin = 0;
+                m_end = 0;
+            }
+        }
+
+        // Set once a message exceeds max_frame_size, the stream cannot be resynchronized after it
+        auto failed() const -> bool
+        {
+            return m_failed;
+        }
+
+      private:
+        std::vector<uint8_t> m_buffer;
+        size_t m_begin = 0;
+        size_t m_end = 0;
+        bool m_failed = false;
+    };
+} // namespace core
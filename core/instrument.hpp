@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core/decimal.hpp"
+
+namespace core
+{
+    using CurrencyId = uint16_t;
+
+    using InstrumentId = uint16_t;
+
+    struct CurrencyInfo
+    {
+        CurrencyId id;
+        std::string_view name;
+        uint8_t scale;
+    };
+
+    // Amounts are counted in lots of the base currency, prices in ticks of the quote currency
+    struct InstrumentInfo
+    {
+        InstrumentId id;
+        std::string_view name;
+        CurrencyId base;
+        CurrencyId quote;
+        uint8_t amount_scale;
+        uint8_t price_scale;
+        uint8_t quote_scale;
+    };
+
+    // Ids are positions in these tables, names are only resolved at the edges (wire, database, console)
+    inline constexpr std::array<CurrencyInfo, 2> currencies{{{0, "USD", 2}, {1, "RUB", 2}}};
+
+    inline constexpr std::array<InstrumentInfo, 1> instruments{{{0, "USD/RUB", 0, 1, 2, 2, 2}}};
+
+    static_assert(std::ranges::all_of(currencies, [](auto const& element) {
+        return &element == &currencies[element.id];
+    }));
+
+    static_assert(std::ranges::all_of(instruments, [](auto const& element) {
+        return &element == &instruments[element.id] && element.base < currencies.size() &&
+               element.quote < currencies.size();
+    }));
+
+    constexpr auto find_currency(std::string_view const name) -> CurrencyInfo const*
+    {
+        auto currency = std::find_if(currencies.begin(), currencies.end(),
+                                     [&](auto const& element) { return element.name == name; });
+        return currency != currencies.end() ? &(*currency) : nullptr;
+    }
+
+    constexpr auto find_currency(CurrencyId const id) -> CurrencyInfo const*
+    {
+        return id < currencies.size() ? &currencies[id] : nullptr;
+    }
+
+    constexpr auto find_instrument(std::string_view const name) -> InstrumentInfo const*
+    {
+        auto instrument = std::find_if(instruments.begin(), instruments.end(),
+                                       [&](auto const& element) { return element.name == name; });
+        return instrument != instruments.end() ? &(*instrument) : nullptr;
+    }
+
+    constexpr auto find_instrument(InstrumentId const id) -> InstrumentInfo const*
+    {
+        return id < instruments.size() ? &instruments[id] : nullptr;
+    }
+
+    // Value of amount lots at price ticks in quote currency units rounded toward zero, or nothing when it does not
+    // fit in int64_t
+    constexpr auto notional(InstrumentInfo const& instrument, int64_t const amount, int64_t const price)
+        -> std::optional<int64_t>
+    {
+        int32_t const shift = instrument.amount_scale + instrument.price_scale - instrument.quote_scale;
+        auto const product = checked_multiply(amount, price);
+        if (!product)
+        {
+            return std::nullopt;
+        }
+        return shift >= 0 ? product.value() / pow10(shift) : checked_multiply(product.value(), pow10(-shift));
+    }
+} // namespace core
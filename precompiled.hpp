@@ -1,12 +1,24 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <random>
 #include <ranges>
+#include <set>
 #include <span>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
@@ -1,4 +1,5 @@
 #include "core.hpp"
+#include "core/instrument.hpp"
 #include "core/json.hpp"
 #include "precompiled.hpp"
 #include <botan/hash.h>
@@ -6,9 +7,14 @@
 
 namespace exchange
 {
-    Core::Core(std::optional<std::filesystem::path> const log_path)
-        : m_database("database.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE), m_login_system(m_database, log_path),
-          m_wallet(m_database, log_path), m_exchange(m_database, log_path)
+    // Requests handled here may wait for an engine, the writer or the checkpointer to release the write lock
+    constexpr int32_t core_busy_timeout = 5000;
+
+    Core::Core(std::optional<std::filesystem::path> const log_path, modules::StorageSettings const& storage,
+               modules::CompactionSettings const& compaction)
+        : m_storage(modules::StorageBackend::create(storage, log_path)), m_database(m_storage->open(core_busy_timeout)),
+          m_login_system(m_database, log_path), m_wallet(m_database, log_path), m_checkpointer(*m_storage, log_path),
+          m_compactor(*m_storage, compaction, log_path)
     {
         std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
         if (log_path)
@@ -17,41 +23,143 @@ namespace exchange
         }
         auto logger = std::make_shared<spdlog::logger>("core", sinks.begin(), sinks.end());
         spdlog::initialize_logger(logger);
+
+        // The journal mode is switched before the engines open their connections. Accounts and wallets are
+        // written on this connection, and no journal replays them
+        try
+        {
+            storage.apply_unjournaled(m_database);
+        }
+        catch (std::exception const& e)
+        {
+            spdlog::get("core")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+        spdlog::get("core")->log(spdlog::level::info, "Storage {} ({}): {}", storage.path.string(),
+                                 m_storage->name(), modules::StorageSettings::describe(m_database));
+        if (m_storage->persistent() && storage.checkpoint_interval > std::chrono::milliseconds::zero())
+        {
+            spdlog::get("core")->log(spdlog::level::info, "WAL checkpoint every {} ms on a background thread",
+                                     storage.checkpoint_interval.count());
+        }
+        if (compaction.interval > std::chrono::seconds::zero())
+        {
+            spdlog::get("core")->log(spdlog::level::info,
+                                     "Ledger compacted every {} s past the last {} rows, history archived to {}",
+                                     compaction.interval.count(), compaction.retained_transactions,
+                                     compaction.archive_path.string());
+        }
+
+        constexpr std::array<std::string_view, 3> acknowledgements{"matching", "the journal sync",
+                                                                   "the database commit"};
+        if (m_storage->journaled())
+        {
+            spdlog::get("core")->log(spdlog::level::info, "Requests are acknowledged after {}",
+                                     acknowledgements[static_cast<size_t>(storage.durability)]);
+        }
+        else
+        {
+            spdlog::get("core")->log(spdlog::level::info, "Nothing is journaled, the {} backend keeps no state",
+                                     m_storage->name());
+        }
+
+        for (auto const& instrument : core::instruments)
+        {
+            // Each engine appends fills to its own journal, named after the instrument id
+            auto journal_path = m_storage->journaled()
+                                    ? std::optional<std::filesystem::path>("journal_" +
+                                                                           std::to_string(instrument.id) + ".bin")
+                                    : std::nullopt;
+            m_engines.emplace_back(
+                std::make_unique<modules::MatchingEngine>(*m_storage, instrument, log_path, std::move(journal_path)));
+            m_engines.back()->on_execution = [this](modules::Execution const& execution) {
+                this->on_execution(execution);
+            };
+        }
     }
 
     Core::~Core()
     {
+        // Whatever the engines and storage threads still write reaches the storage before it is flushed
+        for (auto& engine : m_engines)
+        {
+            engine->stop();
+        }
+        m_compactor.stop();
+        m_checkpointer.stop();
+
+        if (!m_storage->flush())
+        {
+            spdlog::get("core")->log(spdlog::level::err, "Storage {} was not flushed",
+                                     m_storage->settings().path.string());
+        }
         spdlog::drop("core");
     }
 
-    auto Core::start() -> void
+    Core::ModuleLoggers::~ModuleLoggers()
     {
-        m_exchange.process_requests(m_wallet);
+        for (auto const name : {"exchange", "journal", "storage", "wallet"})
+        {
+            spdlog::drop(name);
+        }
     }
 
-    auto Core::on_session_connected(uint64_t const session_id) -> void
+    auto Core::start(std::chrono::milliseconds const opening_auction) -> void
     {
+        for (auto& engine : m_engines)
+        {
+            engine->start(opening_auction);
+        }
+        m_checkpointer.start();
+        m_compactor.start();
+    }
+
+    auto Core::on_session_connected(uint64_t const session_id, ResponseHandler const& push) -> void
+    {
+        std::lock_guard lock(m_mutex);
         m_login_system.initialize_session(session_id);
         m_srp6_sessions[session_id] = {};
+
+        std::lock_guard pushes_lock(m_pushes_mutex);
+        m_session_pushes[session_id] = push;
     }
 
     auto Core::on_session_closed(uint64_t const session_id) -> void
     {
+        std::lock_guard lock(m_mutex);
+        this->forget_user_session(session_id);
         m_login_system.close_session(session_id);
         m_srp6_sessions.erase(session_id);
+
+        std::lock_guard pushes_lock(m_pushes_mutex);
+        m_session_pushes.erase(session_id);
     }
 
-    auto Core::on_message(uint64_t const session_id, std::span<uint8_t const> const buffer) -> Response
+    auto Core::on_message(uint64_t const session_id, std::span<uint8_t const> const buffer,
+                          ResponseHandler const& send_response) -> void
     {
+        // Clients keeping several requests in flight tag them with an id, every response to one echoes it
+        std::optional<uint64_t> correlation_id;
         try
         {
             auto packet = nlohmann::json::parse(buffer);
+            if (packet.contains("id"))
+            {
+                correlation_id = packet["id"].get<uint64_t>();
+            }
+            ResponseHandler const on_response = [send_response, correlation_id](Response const& response) {
+                send_response(Response(response).correlate(correlation_id));
+            };
+
             auto message_type = static_cast<core::RequestMessageType>(packet["type"].get<uint16_t>());
             auto payload = packet["payload"];
 
             spdlog::get("server")->log(spdlog::level::trace, "Packet (msg: {}) was received",
                                        static_cast<uint16_t>(message_type));
 
+            // Held while the request is handled, orders are only handed over to their engine threads under it
+            std::lock_guard lock(m_mutex);
+
             switch (message_type)
             {
                 case core::RequestMessageType::MakeRequest: {
@@ -59,33 +167,72 @@ namespace exchange
                     if (!m_login_system.auth_session(session_id))
                     {
                         response["error_code"] = core::ErrorCode::Restricted;
-                        return Response(core::RequestMessageType::MakeRequest, response);
+                        return on_response(Response(core::RequestMessageType::MakeRequest, response));
                     }
 
-                    auto const currency = payload["currency"].get<std::string>();
-                    auto const amount = payload["amount"].get<float>();
-                    auto const price = payload["price"].get<float>();
+                    // Ids are read at full width and narrowed once in range, so a large one cannot wrap into
+                    // another instrument or request type
+                    auto const requested_instrument = payload["instrument_id"].get<uint64_t>();
+                    auto const amount = payload["amount"].get<int64_t>();
+                    auto const price = payload["price"].get<int64_t>();
 
-                    auto const request_type = payload["request_type"].get<uint32_t>();
-                    if (!(request_type == 0 || request_type == 1))
+                    // Orders worth more than an int64_t of the quote currency could never be settled
+                    auto const request_type = payload["request_type"].get<uint64_t>();
+                    if (!(request_type == 0 || request_type == 1) || amount <= 0 || price <= 0 ||
+                        requested_instrument >= m_engines.size() ||
+                        !core::notional(*core::find_instrument(static_cast<core::InstrumentId>(requested_instrument)),
+                                        amount, price))
                     {
                         response["error_code"] = core::ErrorCode::ValidationError;
-                        return Response(core::RequestMessageType::MakeRequest, response);
+                        return on_response(Response(core::RequestMessageType::MakeRequest, response));
                     }
+                    auto const instrument_id = static_cast<core::InstrumentId>(requested_instrument);
 
-                    if (!m_exchange.make_request(m_login_system.user_id(session_id), currency, amount, price,
-                                                 static_cast<modules::RequestType>(request_type)))
+                    // The response is sent from the engine thread once the request is matched
+                    m_engines[instrument_id]->submit_order(
+                        m_login_system.user_id(session_id), amount, price,
+                        static_cast<modules::RequestType>(request_type),
+                        [on_response](bool const successful, uint64_t const request_id) {
+                            nlohmann::json response;
+                            if (successful)
+                            {
+                                response["error_code"] = core::ErrorCode::Success;
+                                response["request_id"] = request_id;
+                            }
+                            else
+                            {
+                                response["error_code"] = core::ErrorCode::DBFailed;
+                            }
+                            on_response(Response(core::RequestMessageType::MakeRequest, response));
+                        });
+                }
+                break;
+
+                case core::RequestMessageType::CancelRequest: {
+                    nlohmann::json response;
+                    if (!m_login_system.auth_session(session_id))
                     {
-                        response["error_code"] = core::ErrorCode::DBFailed;
-                        return Response(core::RequestMessageType::MakeRequest, response);
+                        response["error_code"] = core::ErrorCode::Restricted;
+                        return on_response(Response(core::RequestMessageType::CancelRequest, response));
                     }
-                    else
-                    {
-                        m_exchange.process_requests(m_wallet);
 
-                        response["error_code"] = core::ErrorCode::Success;
-                        return Response(core::RequestMessageType::MakeRequest, response);
+                    auto const requested_instrument = payload["instrument_id"].get<uint64_t>();
+                    auto const request_id = payload["request_id"].get<uint64_t>();
+
+                    if (requested_instrument >= m_engines.size())
+                    {
+                        response["error_code"] = core::ErrorCode::ValidationError;
+                        return on_response(Response(core::RequestMessageType::CancelRequest, response));
                     }
+                    auto const instrument_id = static_cast<core::InstrumentId>(requested_instrument);
+
+                    m_engines[instrument_id]->cancel_order(
+                        m_login_system.user_id(session_id), request_id, [on_response](bool const successful) {
+                            nlohmann::json response;
+                            response["error_code"] =
+                                successful ? core::ErrorCode::Success : core::ErrorCode::RequestNotFound;
+                            on_response(Response(core::RequestMessageType::CancelRequest, response));
+                        });
                 }
                 break;
 
@@ -94,20 +241,20 @@ namespace exchange
                     if (!m_login_system.auth_session(session_id))
                     {
                         response["error_code"] = core::ErrorCode::Restricted;
-                        return Response(core::RequestMessageType::WalletList, response);
+                        return on_response(Response(core::RequestMessageType::WalletList, response));
                     }
 
                     auto result = m_wallet.wallets(m_login_system.user_id(session_id));
                     if (!result)
                     {
                         response["error_code"] = core::ErrorCode::DBFailed;
-                        return Response(core::RequestMessageType::WalletList, response);
+                        return on_response(Response(core::RequestMessageType::WalletList, response));
                     }
                     else
                     {
                         response["error_code"] = core::ErrorCode::Success;
                         response["wallets"] = result.value();
-                        return Response(core::RequestMessageType::WalletList, response);
+                        return on_response(Response(core::RequestMessageType::WalletList, response));
                     }
                     break;
                 }
@@ -115,12 +262,13 @@ namespace exchange
                 case core::RequestMessageType::Logout: {
                     if (m_login_system.auth_session(session_id))
                     {
+                        this->forget_user_session(session_id);
                         m_login_system.logout_session(session_id);
-                        return Response(core::RequestMessageType::Logout, std::nullopt);
+                        return on_response(Response(core::RequestMessageType::Logout, std::nullopt));
                     }
                     else
                     {
-                        return Response(core::RequestMessageType::Unknown, std::nullopt);
+                        return on_response(Response(core::RequestMessageType::Unknown, std::nullopt));
                     }
                     break;
                 }
@@ -131,27 +279,55 @@ namespace exchange
                     {
                         nlohmann::json response;
                         response["error_code"] = core::ErrorCode::AuthExists;
-                        return Response(core::RequestMessageType::Register, response);
+                        return on_response(Response(core::RequestMessageType::Register, response));
                     }
                     else
                     {
                         auto const verifier = payload["verifier"].get<std::string>();
 
+                        // The account is only created with all its wallets, a user without them could never trade
                         nlohmann::json response;
-                        uint64_t user_id;
-                        if (m_login_system.register_account(user_name, verifier, user_id))
+                        try
                         {
+                            SQLite::Transaction transaction(m_database, SQLite::TransactionBehavior::IMMEDIATE);
+
+                            uint64_t user_id;
+                            if (!m_login_system.register_account(user_name, verifier, user_id))
+                            {
+                                response["error_code"] = core::ErrorCode::AuthFailed;
+                                return on_response(Response(core::RequestMessageType::Register, response));
+                            }
+
                             uint64_t wallet_id;
-                            m_wallet.create_wallet(user_id, "USD", wallet_id);
-                            m_wallet.create_wallet(user_id, "RUB", wallet_id);
+                            for (auto const& currency : core::currencies)
+                            {
+                                if (!m_wallet.create_wallet(user_id, currency.name, wallet_id))
+                                {
+                                    response["error_code"] = core::ErrorCode::DBFailed;
+                                    return on_response(Response(core::RequestMessageType::Register, response));
+                                }
+                            }
 
+                            transaction.commit();
+
+                            // No journal replays accounts and wallets, a backend keeping them in memory writes them
+                            // out before the user is told they exist. With the journal backend that is a copy of
+                            // the whole database, and every other message waits for it under the lock
+                            if (!m_storage->flush())
+                            {
+                                spdlog::get("core")->log(spdlog::level::err,
+                                                         "Account {} may not survive a restart", user_name);
+                                response["error_code"] = core::ErrorCode::DBFailed;
+                                return on_response(Response(core::RequestMessageType::Register, response));
+                            }
                             response["error_code"] = core::ErrorCode::Success;
                         }
-                        else
+                        catch (SQLite::Exception e)
                         {
-                            response["error_code"] = core::ErrorCode::AuthFailed;
+                            spdlog::get("core")->log(spdlog::level::err, e.what());
+                            response["error_code"] = core::ErrorCode::DBFailed;
                         }
-                        return Response(core::RequestMessageType::Register, response);
+                        return on_response(Response(core::RequestMessageType::Register, response));
                     }
                     break;
                 }
@@ -162,17 +338,19 @@ namespace exchange
                     {
                         nlohmann::json response;
                         response["error_code"] = core::ErrorCode::AuthNotFound;
-                        return Response(core::RequestMessageType::ChallengeLogin, response);
+                        return on_response(Response(core::RequestMessageType::ChallengeLogin, response));
                     }
                     else
                     {
                         auto const verifier = payload["verifier"].get<std::string>();
 
+                        // The session may still be logged in as the user it switches from
+                        this->forget_user_session(session_id);
                         if (!m_login_system.login_account(user_name, verifier, session_id))
                         {
                             nlohmann::json response;
                             response["error_code"] = core::ErrorCode::AuthFailed;
-                            return Response(core::RequestMessageType::ChallengeLogin, response);
+                            return on_response(Response(core::RequestMessageType::ChallengeLogin, response));
                         }
                         else
                         {
@@ -187,7 +365,7 @@ namespace exchange
                             nlohmann::json response;
                             response["error_code"] = core::ErrorCode::Success;
                             response["B"] = B;
-                            return Response(core::RequestMessageType::ChallengeLogin, response);
+                            return on_response(Response(core::RequestMessageType::ChallengeLogin, response));
                         }
                     }
                 }
@@ -210,6 +388,10 @@ namespace exchange
                     if (M.compare(M1) == 0)
                     {
                         m_login_system.login_session(session_id);
+                        this->forget_user_session(session_id);
+
+                        std::lock_guard pushes_lock(m_pushes_mutex);
+                        m_user_sessions.emplace(m_login_system.user_id(session_id), session_id);
 
                         response["error_code"] = core::ErrorCode::Success;
                     }
@@ -217,17 +399,56 @@ namespace exchange
                     {
                         response["error_code"] = core::ErrorCode::AuthFailed;
                     }
-                    return Response(core::RequestMessageType::ChallengeProof, response);
+                    return on_response(Response(core::RequestMessageType::ChallengeProof, response));
                 }
 
                 default: {
-                    return Response(core::RequestMessageType::Unknown, std::nullopt);
+                    return on_response(Response(core::RequestMessageType::Unknown, std::nullopt));
                 }
             }
         }
         catch (nlohmann::json::exception e)
         {
-            return Response(core::RequestMessageType::Unknown, std::nullopt);
+            return send_response(Response(core::RequestMessageType::Unknown, std::nullopt).correlate(correlation_id));
+        }
+    }
+
+    auto Core::on_execution(modules::Execution const& execution) -> void
+    {
+        nlohmann::json report;
+        report["instrument_id"] = execution.instrument;
+        report["request_id"] = execution.request_id;
+        report["request_type"] = static_cast<uint32_t>(execution.request_type);
+        report["amount"] = execution.amount;
+        report["price"] = execution.price;
+        report["remaining"] = execution.remaining;
+
+        std::lock_guard lock(m_pushes_mutex);
+        auto const [begin, end] = m_user_sessions.equal_range(execution.user_id);
+        for (auto it = begin; it != end; ++it)
+        {
+            auto const push = m_session_pushes.find(it->second);
+            if (push != m_session_pushes.end())
+            {
+                push->second(Response(core::RequestMessageType::ExecutionReport, report));
+            }
+        }
+    }
+
+    auto Core::forget_user_session(uint64_t const session_id) -> void
+    {
+        if (!m_login_system.auth_session(session_id))
+        {
+            return;
+        }
+
+        std::lock_guard lock(m_pushes_mutex);
+        auto const [begin, end] = m_user_sessions.equal_range(m_login_system.user_id(session_id));
+        auto const it =
+            std::find_if(begin, end, [session_id](auto const& element) { return element.second == session_id; });
+        if (it != end)
+        {
+            m_user_sessions.erase(it);
         }
     }
 } // namespace exchange
\ No newline at end of file
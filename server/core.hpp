@@ -1,7 +1,9 @@
 #pragma once
 
-#include "modules/exchange.hpp"
+#include "modules/ledger_compactor.hpp"
 #include "modules/login.hpp"
+#include "modules/matching_engine.hpp"
+#include "modules/storage.hpp"
 #include "modules/wallet.hpp"
 #include "session.hpp"
 #include <botan/srp6.h>
@@ -11,17 +13,21 @@ namespace exchange
     class Core
     {
       public:
-        Core(std::optional<std::filesystem::path> const log_path);
+        Core(std::optional<std::filesystem::path> const log_path, modules::StorageSettings const& storage,
+             modules::CompactionSettings const& compaction);
 
         ~Core();
 
-        auto start() -> void;
+        auto start(std::chrono::milliseconds const opening_auction) -> void;
 
-        auto on_session_connected(uint64_t const session_id) -> void;
+        // Messages pushed to the session go through push, which may outlive the session
+        auto on_session_connected(uint64_t const session_id, ResponseHandler const& push) -> void;
 
         auto on_session_closed(uint64_t const session_id) -> void;
 
-        auto on_message(uint64_t const session_id, std::span<uint8_t const> const buffer) -> Response;
+        // Called from any I/O thread, messages are parsed in parallel and handled one at a time
+        auto on_message(uint64_t const session_id, std::span<uint8_t const> const buffer,
+                        ResponseHandler const& on_response) -> void;
 
       private:
         struct SRP6Session
@@ -31,12 +37,39 @@ namespace exchange
             std::string B;
         };
 
+        // Module loggers are shared by every engine, its writer and the storage threads. Declared first, so they
+        // are dropped once the last of those is destroyed
+        struct ModuleLoggers
+        {
+            ~ModuleLoggers();
+        };
+        ModuleLoggers m_module_loggers;
+
+        // Guards the session state and the connection shared by the login system and the wallet
+        std::mutex m_mutex;
+
         std::unordered_map<uint64_t, SRP6Session> m_srp6_sessions;
 
+        // Execution reports go to every session logged in as the owner of the request. Engine threads report
+        // under their own mutex, so they never wait for a login or a database query behind m_mutex
+        std::mutex m_pushes_mutex;
+        std::unordered_map<uint64_t, ResponseHandler> m_session_pushes;
+        std::unordered_multimap<uint64_t, uint64_t> m_user_sessions;
+
+        std::unique_ptr<modules::StorageBackend> m_storage;
         SQLite::Database m_database;
 
         modules::LoginSystem m_login_system;
         modules::Wallet m_wallet;
-        modules::Exchange m_exchange;
+        modules::Checkpointer m_checkpointer;
+        modules::LedgerCompactor m_compactor;
+
+        // Indexed by instrument id
+        std::vector<std::unique_ptr<modules::MatchingEngine>> m_engines;
+
+        auto on_execution(modules::Execution const& execution) -> void;
+
+        // Takes m_pushes_mutex, the caller holds m_mutex
+        auto forget_user_session(uint64_t const session_id) -> void;
     };
 } // namespace exchange
\ No newline at end of file
@@ -18,6 +18,109 @@ auto main(int32_t argc, char** argv) -> int32_t
         log_path = "server.log";
     }
 
+    // Length of the opening call auction in seconds, zero starts continuous matching right away
+    uint32_t auction;
+    if (!(command_line({"-a", "--auction"}) >> auction))
+    {
+        auction = 0;
+    }
+
+    exchange::modules::StorageSettings storage;
+    std::string database_path;
+    if (command_line({"-d", "--database"}) >> database_path)
+    {
+        storage.path = database_path;
+    }
+
+    // Where the tables live: sqlite, memory or journal
+    std::string backend;
+    if (command_line({"--backend"}) >> backend)
+    {
+        if (backend == "sqlite")
+        {
+            storage.backend = exchange::modules::BackendType::SQLite;
+        }
+        else if (backend == "memory")
+        {
+            storage.backend = exchange::modules::BackendType::Memory;
+        }
+        else if (backend == "journal")
+        {
+            storage.backend = exchange::modules::BackendType::Journal;
+        }
+        else
+        {
+            std::cerr << "Unknown backend: " << backend << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    command_line({"--journal-mode"}) >> storage.journal_mode;
+    command_line({"--synchronous"}) >> storage.synchronous;
+
+    // Sizes are given in MiB
+    int64_t mmap_size;
+    if (command_line({"--mmap-size"}) >> mmap_size)
+    {
+        storage.mmap_size = mmap_size * 1024 * 1024;
+    }
+    int64_t cache_size;
+    if (command_line({"--cache-size"}) >> cache_size)
+    {
+        storage.cache_size = -cache_size * 1024;
+    }
+
+    // Milliseconds between WAL checkpoints, zero lets SQLite checkpoint on commit
+    uint32_t checkpoint;
+    if (command_line({"--checkpoint"}) >> checkpoint)
+    {
+        storage.checkpoint_interval = std::chrono::milliseconds(checkpoint);
+    }
+
+    // When requests are acknowledged: memory, journal or database
+    std::string durability;
+    if (command_line({"--durability"}) >> durability)
+    {
+        if (durability == "memory")
+        {
+            storage.durability = exchange::modules::Durability::Memory;
+        }
+        else if (durability == "journal")
+        {
+            storage.durability = exchange::modules::Durability::Journal;
+        }
+        else if (durability == "database")
+        {
+            storage.durability = exchange::modules::Durability::Database;
+        }
+        else
+        {
+            std::cerr << "Unknown durability: " << durability << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Ledger rows older than the last --retain ones are rolled into checkpoints every --compact seconds
+    exchange::modules::CompactionSettings compaction;
+    std::string archive_path;
+    if (command_line({"--archive"}) >> archive_path)
+    {
+        compaction.archive_path = archive_path;
+    }
+    uint32_t compact;
+    if (command_line({"--compact"}) >> compact)
+    {
+        compaction.interval = std::chrono::seconds(compact);
+    }
+    command_line({"--retain"}) >> compaction.retained_transactions;
+
+    // Threads running socket I/O and request parsing, one per core by default
+    uint32_t threads;
+    if (!(command_line({"--threads"}) >> threads))
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
     if (command_line[{"-t", "--trace"}])
     {
         spdlog::set_level(spdlog::level::trace);
@@ -33,7 +136,8 @@ auto main(int32_t argc, char** argv) -> int32_t
 
     try
     {
-        exchange::Server server(port, std::filesystem::path(log_path).make_preferred());
+        exchange::Server server(port, std::filesystem::path(log_path).make_preferred(),
+                                std::chrono::seconds(auction), storage, compaction, threads);
         server.run();
         return EXIT_SUCCESS;
     }
@@ -0,0 +1,149 @@
+#include "event_writer.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    // The writer shares the file with the engines, so it waits for their writes instead of failing
+    constexpr int32_t writer_busy_timeout = 5000;
+
+    // A failed sync or transaction is tried again after this long, or with the next batch if it comes first
+    constexpr std::chrono::milliseconds retry_interval(100);
+
+    EventWriter::EventWriter(StorageBackend const& storage, Journal& journal,
+                             std::optional<std::filesystem::path> const log_path)
+        : m_durability(storage.settings().durability), m_journal(&journal),
+          m_database(storage.open(writer_busy_timeout)),
+          m_wallet(m_database, log_path),
+          m_exchange(m_database, log_path, std::span<core::InstrumentInfo const>(), &journal),
+          m_drain_scheduled(false), m_unapplied_sequence(0), m_stopping(false),
+          m_work_guard(boost::asio::make_work_guard(m_io_context)), m_retry_timer(m_io_context)
+    {
+        try
+        {
+            storage.settings().apply(m_database);
+        }
+        catch (std::exception const& e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    EventWriter::~EventWriter()
+    {
+        this->stop();
+    }
+
+    auto EventWriter::start() -> void
+    {
+        if (!m_thread.joinable())
+        {
+            m_thread = std::thread([this]() { m_io_context.run(); });
+        }
+    }
+
+    auto EventWriter::stop() -> void
+    {
+        // Batches already queued are written before the thread exits. What still fails then is left to the replay
+        // on the next start, its handlers are never called
+        boost::asio::post(m_io_context, [this]() {
+            m_stopping = true;
+            m_retry_timer.cancel();
+            if (!m_unapplied_events.empty() || !m_unanswered.empty())
+            {
+                this->flush();
+            }
+        });
+        m_work_guard.reset();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    auto EventWriter::write(std::vector<JournalEvent> events, uint64_t const sequence, CommitHandler const& on_commit)
+        -> void
+    {
+        std::lock_guard lock(m_mutex);
+        m_batches.emplace_back(Batch{.events = std::move(events), .sequence = sequence, .on_commit = on_commit});
+
+        if (!m_drain_scheduled)
+        {
+            m_drain_scheduled = true;
+            boost::asio::post(m_io_context, [this]() { this->drain(); });
+        }
+    }
+
+    auto EventWriter::drain() -> void
+    {
+        std::vector<Batch> batches;
+        {
+            std::lock_guard lock(m_mutex);
+            std::swap(batches, m_batches);
+            m_drain_scheduled = false;
+        }
+
+        for (auto& batch : batches)
+        {
+            m_unapplied_events.insert(m_unapplied_events.end(), batch.events.begin(), batch.events.end());
+            m_unapplied_sequence = std::max(m_unapplied_sequence, batch.sequence);
+            m_unanswered.emplace_back(std::move(batch.on_commit));
+        }
+
+        this->flush();
+    }
+
+    auto EventWriter::flush() -> void
+    {
+        // The database never gets ahead of the journal, replay relies on it
+        if (!m_journal->commit())
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Journal {} commit failed", m_journal->path().string());
+            return this->retry();
+        }
+
+        if (m_durability != Durability::Database)
+        {
+            this->answer();
+        }
+
+        if (!m_unapplied_events.empty())
+        {
+            if (!m_exchange.apply_events(m_wallet, m_unapplied_events, m_unapplied_sequence))
+            {
+                spdlog::get("exchange")->log(spdlog::level::err, "{} journal events were not applied",
+                                             m_unapplied_events.size());
+                return this->retry();
+            }
+            m_unapplied_events.clear();
+        }
+
+        this->answer();
+    }
+
+    auto EventWriter::answer() -> void
+    {
+        for (auto const& on_commit : std::exchange(m_unanswered, {}))
+        {
+            on_commit();
+        }
+    }
+
+    auto EventWriter::retry() -> void
+    {
+        if (m_stopping)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "{} journal events are left to the next start",
+                                         m_unapplied_events.size());
+            return;
+        }
+
+        m_retry_timer.expires_after(retry_interval);
+        m_retry_timer.async_wait([this](boost::system::error_code const& error) {
+            if (!error)
+            {
+                this->flush();
+            }
+        });
+    }
+} // namespace exchange::modules
\ No newline at end of file
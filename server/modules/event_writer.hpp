@@ -0,0 +1,74 @@
+#pragma once
+
+#include "core/instrument.hpp"
+#include "exchange.hpp"
+#include "journal.hpp"
+#include "storage.hpp"
+#include "wallet.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    // Syncs the journal and applies its events to the database on a thread of its own, so matching never waits
+    // for the disk. Batches queued while the previous one was written share one sync and one transaction
+    class EventWriter
+    {
+      public:
+        using CommitHandler = std::function<void()>;
+
+        EventWriter(StorageBackend const& storage, Journal& journal,
+                    std::optional<std::filesystem::path> const log_path);
+
+        ~EventWriter();
+
+        auto start() -> void;
+
+        auto stop() -> void;
+
+        // Events must already be appended to the journal up to the sequence.
+        // on_commit runs on the writer thread once the durability policy is met. The events are already in the
+        // book, so a failed sync or transaction is retried until it succeeds rather than reported
+        auto write(std::vector<JournalEvent> events, uint64_t const sequence, CommitHandler const& on_commit)
+            -> void;
+
+      private:
+        struct Batch
+        {
+            std::vector<JournalEvent> events;
+            uint64_t sequence;
+            CommitHandler on_commit;
+        };
+
+        Durability m_durability;
+        Journal* m_journal;
+
+        // An exchange without books applies the events on the writer's own connection
+        SQLite::Database m_database;
+        Wallet m_wallet;
+        Exchange m_exchange;
+
+        std::mutex m_mutex;
+        std::vector<Batch> m_batches;
+        bool m_drain_scheduled;
+
+        // Events the database has not taken yet and the handlers waiting for them, kept until a retry succeeds
+        std::vector<JournalEvent> m_unapplied_events;
+        uint64_t m_unapplied_sequence;
+        std::vector<CommitHandler> m_unanswered;
+        bool m_stopping;
+
+        boost::asio::io_context m_io_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work_guard;
+        boost::asio::steady_timer m_retry_timer;
+        std::thread m_thread;
+
+        auto drain() -> void;
+
+        // Syncs the journal and applies the unapplied events, answering whatever the policy allows
+        auto flush() -> void;
+
+        auto answer() -> void;
+
+        auto retry() -> void;
+    };
+} // namespace exchange::modules
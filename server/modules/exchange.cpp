@@ -1,27 +1,41 @@
 #include "exchange.hpp"
+#include "core/instrument.hpp"
 #include "precompiled.hpp"
+#include "schema.hpp"
 #include "wallet.hpp"
 
 namespace exchange::modules
 {
-    Exchange::Exchange(SQLite::Database& database, std::optional<std::filesystem::path> const log_path)
-        : m_database(&database)
+    // Open requests of a currency are counted and restored in id order straight from the index
+    constexpr std::array<Migration, 1> requests_migrations{
+        {{.version = 1,
+          .statement = "CREATE INDEX IF NOT EXISTS requests_currency ON requests "
+                       "(currency, id, user_id, amount, price, request_type)"}}};
+
+    Exchange::Exchange(SQLite::Database& database, std::optional<std::filesystem::path> const log_path,
+                       std::span<core::InstrumentInfo const> const instruments, Journal* const journal)
+        : m_database(&database), m_statements(database), m_last_request_id(0), m_journal(journal)
     {
-        std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
-        if (log_path)
+        // Every matching engine owns its own instance, and they all share one logger
+        if (!spdlog::get("exchange"))
         {
-            sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("exchange", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
         }
-        auto logger = std::make_shared<spdlog::logger>("exchange", sinks.begin(), sinks.end());
-        spdlog::initialize_logger(logger);
 
         if (!database.tableExists("requests"))
         {
             try
             {
                 SQLite::Statement statement(*m_database,
-                                            "CREATE TABLE requests (id INTEGER PRIMARY KEY, user_id INTEGER, "
-                                            "currency TEXT, amount REAL, price REAL, request_type INTEGER)");
+                                            "CREATE TABLE requests (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                                            "user_id INTEGER, currency TEXT, amount INTEGER, price INTEGER, "
+                                            "request_type INTEGER)");
                 statement.exec();
             }
             catch (SQLite::Exception e)
@@ -30,26 +44,102 @@ namespace exchange::modules
                 std::exit(EXIT_FAILURE);
             }
         }
+        else
+        {
+            this->upgrade_requests();
+        }
+
+        try
+        {
+            migrate(*m_database, "exchange", requests_migrations);
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (m_journal)
+        {
+            try
+            {
+                m_database->exec("CREATE TABLE IF NOT EXISTS journals (path TEXT PRIMARY KEY, sequence INTEGER)");
+            }
+            catch (SQLite::Exception e)
+            {
+                spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+                std::exit(EXIT_FAILURE);
+            }
+        }
+
+        for (auto const& instrument : instruments)
+        {
+            m_books.try_emplace(instrument.id, m_pool);
+        }
+
+        // With a journal the books are restored by replay_journal, possibly without reading every request
+        if (!m_journal)
+        {
+            this->load_requests();
+        }
     }
 
     Exchange::~Exchange()
     {
-        spdlog::drop("exchange");
+        this->flush_cancels();
     }
 
-    auto Exchange::make_request(uint64_t const user_id, std::string_view const currency, float const amount,
-                                float const price, RequestType const request_type) -> bool
+    auto Exchange::make_request(uint64_t const user_id, core::InstrumentId const instrument, int64_t const amount,
+                                int64_t const price, RequestType const request_type) -> bool
     {
+        auto book = m_books.find(instrument);
+        if (book == m_books.end())
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Unknown instrument: {}", instrument);
+            return false;
+        }
+
+        // A fill is never worth more than the request it fills, so it cannot overflow once the request fits
+        if (!core::notional(*core::find_instrument(instrument), amount, price))
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Request from user_id: {} is too large", user_id);
+            return false;
+        }
+
         try
         {
-            SQLite::Statement statement(*m_database, "INSERT INTO requests (user_id, currency, amount, "
-                                                     "price, request_type) VALUES (?, ?, ?, ?, ?)");
-            statement.bind(1, static_cast<int64_t>(user_id));
-            statement.bind(2, std::string(currency));
-            statement.bind(3, amount);
-            statement.bind(4, price);
-            statement.bind(5, static_cast<uint32_t>(request_type));
-            return statement.exec() > 0;
+            auto statement = m_statements.prepare("INSERT INTO requests (user_id, currency, amount, "
+                                                  "price, request_type) VALUES (?, ?, ?, ?, ?) RETURNING id");
+            statement->bind(1, static_cast<int64_t>(user_id));
+            statement->bind(2, std::string(core::find_instrument(instrument)->name));
+            statement->bind(3, amount);
+            statement->bind(4, price);
+            statement->bind(5, static_cast<uint32_t>(request_type));
+            if (!statement->executeStep())
+            {
+                return false;
+            }
+
+            uint64_t const request_id = statement->getColumn(0).getInt64();
+            m_last_request_id = std::max(m_last_request_id, request_id);
+
+            if (m_journal)
+            {
+                m_journal->append(JournalEvent{.type = JournalEventType::OrderAccepted,
+                                               .instrument = instrument,
+                                               .request_type = request_type,
+                                               .request_id = request_id,
+                                               .user_id = user_id,
+                                               .amount = amount,
+                                               .price = price});
+            }
+
+            book->second.insert(Order{.request_id = request_id,
+                                      .user_id = user_id,
+                                      .amount = amount,
+                                      .price = price,
+                                      .request_type = request_type});
+            return true;
         }
         catch (SQLite::Exception e)
         {
@@ -62,9 +152,21 @@ namespace exchange::modules
     {
         try
         {
-            SQLite::Statement statement(*m_database, "DELETE FROM requests WHERE id = ?");
-            statement.bind(1, static_cast<int64_t>(request_id));
-            return statement.exec() > 0;
+            auto statement = m_statements.prepare("DELETE FROM requests WHERE id = ?");
+            statement->bind(1, static_cast<int64_t>(request_id));
+            if (statement->exec() == 0)
+            {
+                return false;
+            }
+
+            for (auto& [instrument, book] : m_books)
+            {
+                if (book.erase(request_id))
+                {
+                    break;
+                }
+            }
+            return true;
         }
         catch (SQLite::Exception e)
         {
@@ -73,202 +175,867 @@ namespace exchange::modules
         }
     }
 
-    auto Exchange::process_requests(Wallet& wallet) -> void
+    auto Exchange::submit_order(Wallet& wallet, uint64_t const user_id, core::InstrumentId const instrument,
+                                int64_t const amount, int64_t const price, RequestType const request_type,
+                                uint64_t& request_id) -> bool
     {
+        auto book = m_books.find(instrument);
+        if (book == m_books.end())
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Unknown instrument: {}", instrument);
+            return false;
+        }
+
+        // A fill is never worth more than the request it fills, so it cannot overflow once the request fits
+        if (!core::notional(*core::find_instrument(instrument), amount, price))
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Request from user_id: {} is too large", user_id);
+            return false;
+        }
+
+        // Fills of the request could never be settled, and with a journal one would hold back every later event
+        if (!this->has_wallets(wallet, *core::find_instrument(instrument), user_id))
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Wallets of user_id: {} were not found", user_id);
+            return false;
+        }
+
         try
         {
-            SQLite::Statement buyers_statement(*m_database, "SELECT id, user_id, amount, price, currency FROM requests "
-                                                            "WHERE request_type = 0 ORDER BY price DESC, id ASC");
+            {
+                auto statement = m_statements.prepare("INSERT INTO requests (user_id, currency, amount, "
+                                                      "price, request_type) VALUES (?, ?, ?, ?, ?) RETURNING id");
+                statement->bind(1, static_cast<int64_t>(user_id));
+                statement->bind(2, std::string(core::find_instrument(instrument)->name));
+                statement->bind(3, amount);
+                statement->bind(4, price);
+                statement->bind(5, static_cast<uint32_t>(request_type));
+                if (!statement->executeStep())
+                {
+                    return false;
+                }
+                request_id = statement->getColumn(0).getInt64();
+                m_last_request_id = std::max(m_last_request_id, request_id);
+            }
 
-            while (buyers_statement.executeStep())
+            if (m_journal)
             {
-                auto const buyer_request_id = static_cast<uint64_t>(buyers_statement.getColumn(0).getInt64());
-                auto const buyer_user_id = static_cast<uint64_t>(buyers_statement.getColumn(1).getInt64());
-                float const buyer_amount = buyers_statement.getColumn(2).getDouble();
+                m_journal->append(JournalEvent{.type = JournalEventType::OrderAccepted,
+                                               .instrument = instrument,
+                                               .request_type = request_type,
+                                               .request_id = request_id,
+                                               .user_id = user_id,
+                                               .amount = amount,
+                                               .price = price});
+            }
 
-                float const price = buyers_statement.getColumn(3).getDouble();
-                std::string const currency = buyers_statement.getColumn(4).getString();
+            Order order{.request_id = request_id,
+                        .user_id = user_id,
+                        .amount = amount,
+                        .price = price,
+                        .request_type = request_type};
 
-                std::vector<std::string> currencies;
-                boost::split(currencies, currency, boost::is_any_of("/"));
+            // Only the incoming request can cross the book, so the resting side is left as is.
+            // During a call auction requests only accumulate until the book is uncrossed
+            if (!m_auctions.contains(instrument) &&
+                !book->second.match(order, this->fill_handler(wallet, *core::find_instrument(instrument))))
+            {
+                spdlog::get("exchange")->log(spdlog::level::err, "Request (id: {}) was not fully matched",
+                                             order.request_id);
+            }
 
-                bool is_partial = false;
-                {
-                    SQLite::Statement sellers_statement(
-                        *m_database,
-                        "SELECT id, user_id, amount FROM requests WHERE request_type = 1 "
-                        "and price <= ? "
-                        "and amount >= ? and currency = ? and user_id != ? ORDER BY price ASC, id ASC LIMIT 1");
-                    sellers_statement.bind(1, price);
-                    sellers_statement.bind(2, buyer_amount);
-                    sellers_statement.bind(3, currency);
-                    sellers_statement.bind(4, static_cast<int64_t>(buyer_user_id));
-
-                    if (sellers_statement.executeStep())
-                    {
-                        auto const seller_request_id = static_cast<uint64_t>(sellers_statement.getColumn(0).getInt64());
-                        auto const seller_user_id = static_cast<uint64_t>(sellers_statement.getColumn(1).getInt64());
-                        float const seller_amount = sellers_statement.getColumn(2).getDouble();
-
-                        RequestSideInfo buyer_info{.request_id = buyer_request_id,
-                                                   .user_id = buyer_user_id,
-                                                   .amount = buyer_amount,
-                                                   .currency = currencies[0]};
-                        RequestSideInfo seller_info{.request_id = seller_request_id,
-                                                    .user_id = seller_user_id,
-                                                    .amount = seller_amount,
-                                                    .currency = currencies[1]};
-                        SQLite::Transaction transaction(*m_database);
-                        this->request_step(wallet, transaction, buyer_info, seller_info, price);
-
-                        // Skip partial trade if successful
-                        continue;
-                    }
-                    else
+            if (order.amount > 0)
+            {
+                book->second.insert(order);
+            }
+            return true;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, e.what());
+            return false;
+        }
+    }
+
+    auto Exchange::cancel_request(uint64_t const user_id, uint64_t const request_id) -> bool
+    {
+        for (auto& [instrument, book] : m_books)
+        {
+            auto const order = book.find(request_id);
+            if (!order)
+            {
+                continue;
+            }
+
+            if (order->user_id != user_id)
+            {
+                return false;
+            }
+
+            JournalEvent const event{.type = JournalEventType::OrderCancelled,
+                                     .instrument = instrument,
+                                     .request_type = order->request_type,
+                                     .request_id = request_id,
+                                     .user_id = user_id,
+                                     .amount = order->amount,
+                                     .price = order->price};
+
+            // The request leaves the book right away, its row is deleted by the next flush_cancels
+            // or, with a journal, by the next commit_journal
+            book.erase(request_id);
+            if (m_journal)
+            {
+                m_journal->append(event);
+                m_pending_events.emplace_back(event);
+            }
+            else
+            {
+                m_cancelled_requests.emplace_back(request_id);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    auto Exchange::flush_cancels() -> bool
+    {
+        if (m_cancelled_requests.empty())
+        {
+            return true;
+        }
+
+        try
+        {
+            SQLite::Transaction transaction(*m_database, SQLite::TransactionBehavior::IMMEDIATE);
+            auto statement = m_statements.prepare("DELETE FROM requests WHERE id = ?");
+            for (uint64_t const request_id : m_cancelled_requests)
+            {
+                statement->bind(1, static_cast<int64_t>(request_id));
+                statement->exec();
+                statement->reset();
+            }
+            transaction.commit();
+
+            m_cancelled_requests.clear();
+            return true;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, e.what());
+            return false;
+        }
+    }
+
+    auto Exchange::process_requests(Wallet& wallet) -> bool
+    {
+        // A book stops at the first fill that was rolled back, its requests stay crossed for the next call
+        bool successful = true;
+        for (auto& [instrument, book] : m_books)
+        {
+            auto const& instrument_info = *core::find_instrument(instrument);
+            if (!m_auctions.contains(instrument) && !book.match(this->fill_handler(wallet, instrument_info)))
+            {
+                spdlog::get("exchange")->log(spdlog::level::err, "{} matching stopped at a fill that was rolled back",
+                                             instrument_info.name);
+                successful = false;
+            }
+        }
+        return successful;
+    }
+
+    auto Exchange::begin_auction(core::InstrumentId const instrument) -> bool
+    {
+        if (!m_books.contains(instrument))
+        {
+            return false;
+        }
+
+        m_auctions.insert(instrument);
+        return true;
+    }
+
+    auto Exchange::uncross(Wallet& wallet, core::InstrumentId const instrument) -> bool
+    {
+        auto book = m_books.find(instrument);
+        if (book == m_books.end() || !m_auctions.erase(instrument))
+        {
+            return false;
+        }
+
+        auto const& instrument_info = *core::find_instrument(instrument);
+
+        auto const auction = book->second.auction();
+        if (!auction)
+        {
+            spdlog::get("exchange")->log(spdlog::level::info, "{} auction closed without crossing requests",
+                                         instrument_info.name);
+            return true;
+        }
+
+        auto const log_auction = [&]() {
+            spdlog::get("exchange")->log(spdlog::level::info, "{} auction uncrossed at {} for {}",
+                                         instrument_info.name,
+                                         core::Decimal(auction->price, instrument_info.price_scale).to_string(),
+                                         core::Decimal(auction->volume, instrument_info.amount_scale).to_string());
+        };
+
+        // Journaled fills are persisted together by the next commit_journal anyway
+        if (m_journal)
+        {
+            if (!book->second.uncross(auction->price, this->fill_handler(wallet, instrument_info)))
+            {
+                return false;
+            }
+
+            log_auction();
+            return true;
+        }
+
+        try
+        {
+            // All fills of the auction are persisted by a single transaction and reported once it is committed
+            std::vector<Execution> executions;
+            SQLite::Transaction transaction(*m_database, SQLite::TransactionBehavior::IMMEDIATE);
+            bool const successful = book->second.uncross(
+                auction->price, [&](Order const& buyer, Order const& seller, int64_t const amount,
+                                    int64_t const price) -> bool {
+                    auto const [buyer_info, seller_info] = this->side_infos(instrument_info, buyer, seller);
+                    if (!this->request_step(wallet, transaction, instrument_info, buyer_info, seller_info, amount,
+                                            price))
                     {
-                        is_partial = true;
+                        return false;
                     }
+
+                    auto const fill = this->executions(instrument_info, buyer, seller, amount, price);
+                    executions.insert(executions.end(), fill.begin(), fill.end());
+                    return true;
+                });
+
+            if (successful)
+            {
+                transaction.commit();
+                this->report(executions);
+
+                log_auction();
+                return true;
+            }
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, e.what());
+        }
+
+        // Fills were already applied to the book, so it is restored from the rolled back requests table
+        try
+        {
+            book->second.clear();
+            this->load_book(instrument, book->second);
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+        return false;
+    }
+
+    auto Exchange::commit_journal(Wallet& wallet) -> bool
+    {
+        if (!m_journal)
+        {
+            return true;
+        }
+
+        // Events appended since the last commit share one sync of the journal and one database transaction
+        if (!m_journal->commit())
+        {
+            return false;
+        }
+
+        if (m_pending_events.empty())
+        {
+            return true;
+        }
+
+        // Events that were not applied stay pending, the journal already holds them
+        if (!this->apply_events(wallet, m_pending_events, m_journal->sequence()))
+        {
+            return false;
+        }
+
+        m_pending_events.clear();
+        return true;
+    }
+
+    auto Exchange::take_journal_events() -> std::vector<JournalEvent>
+    {
+        auto events = std::move(m_pending_events);
+        m_pending_events.clear();
+        return events;
+    }
+
+    auto Exchange::replay_journal(Wallet& wallet, std::optional<std::filesystem::path> const& snapshot_path) -> bool
+    {
+        if (!m_journal)
+        {
+            return true;
+        }
+
+        try
+        {
+            uint64_t applied_sequence = 0;
+            {
+                auto statement = m_statements.prepare("SELECT sequence FROM journals WHERE path = ?");
+                statement->bind(1, m_journal->path().string());
+                if (statement->executeStep())
+                {
+                    applied_sequence = statement->getColumn(0).getInt64();
                 }
+            }
+
+            // A snapshot ahead of the journal does not belong to it
+            auto snapshot = snapshot_path ? Snapshot::load(snapshot_path.value()) : std::nullopt;
+            if (snapshot && snapshot->sequence > m_journal->committed_sequence())
+            {
+                spdlog::get("exchange")->log(spdlog::level::warn, "Snapshot at sequence {} is ahead of the journal",
+                                             snapshot->sequence);
+                snapshot.reset();
+            }
+
+            // Only the journal tail after the database or the snapshot, whichever is older, is read
+            uint64_t const after = snapshot ? std::min(applied_sequence, snapshot->sequence) : applied_sequence;
+            std::vector<std::pair<uint64_t, JournalEvent>> tail;
+            m_journal->replay(after, [&](uint64_t const sequence, JournalEvent const& event) {
+                tail.emplace_back(sequence, event);
+                return true;
+            });
 
-                if (is_partial)
+            std::vector<JournalEvent> events;
+            for (auto const& [sequence, event] : tail)
+            {
+                if (sequence > applied_sequence)
                 {
-                    SQLite::Statement sellers_statement(
-                        *m_database, "SELECT id, user_id, amount FROM requests WHERE request_type = 1 "
-                                     "and price <= ? "
-                                     "and amount < ? and currency = ? and user_id != ? ORDER BY price ASC, id ASC");
-                    sellers_statement.bind(1, price);
-                    sellers_statement.bind(2, buyer_amount);
-                    sellers_statement.bind(3, currency);
-                    sellers_statement.bind(4, static_cast<int64_t>(buyer_user_id));
-
-                    float diff_amount = buyer_amount;
-
-                    while (sellers_statement.executeStep() && diff_amount > 0)
-                    {
-                        auto const seller_request_id = static_cast<uint64_t>(sellers_statement.getColumn(0).getInt64());
-                        auto const seller_user_id = static_cast<uint64_t>(sellers_statement.getColumn(1).getInt64());
-                        float const seller_amount = sellers_statement.getColumn(2).getDouble();
-
-                        RequestSideInfo buyer_info{.request_id = buyer_request_id,
-                                                   .user_id = buyer_user_id,
-                                                   .amount = diff_amount,
-                                                   .currency = currencies[0]};
-                        RequestSideInfo seller_info{.request_id = seller_request_id,
-                                                    .user_id = seller_user_id,
-                                                    .amount = seller_amount,
-                                                    .currency = currencies[1]};
-                        SQLite::Transaction transaction(*m_database);
-                        this->request_step(wallet, transaction, buyer_info, seller_info, price);
-                        diff_amount -= seller_amount;
-                    }
+                    events.emplace_back(event);
+                }
+            }
+
+            if (!events.empty())
+            {
+                if (!this->apply_events(wallet, events, m_journal->committed_sequence()))
+                {
+                    return false;
+                }
+
+                spdlog::get("exchange")->log(spdlog::level::info,
+                                             "{} journal events were applied after sequence {}", events.size(),
+                                             applied_sequence);
+            }
+
+            for (auto& [instrument, book] : m_books)
+            {
+                book.clear();
+            }
+
+            if (!snapshot)
+            {
+                this->load_requests();
+                return true;
+            }
+
+            m_pool.reserve(snapshot->orders.size());
+            for (auto const& [instrument, order] : snapshot->orders)
+            {
+                if (auto book = m_books.find(instrument); book != m_books.end())
+                {
+                    book->second.insert(order);
                 }
             }
+            m_last_request_id = std::max(m_last_request_id, snapshot->last_request_id);
+
+            for (auto const& [sequence, event] : tail)
+            {
+                if (sequence > snapshot->sequence)
+                {
+                    this->restore_event(event);
+                }
+            }
+
+            // Requests inserted after the last journal commit were never journaled, but their rows are there
+            for (auto& [instrument, book] : m_books)
+            {
+                this->load_book(instrument, book, m_last_request_id);
+            }
+
+            spdlog::get("exchange")->log(spdlog::level::info,
+                                         "Requests were restored from the snapshot at sequence {} and {} "
+                                         "journal events",
+                                         snapshot->sequence, m_journal->committed_sequence() - snapshot->sequence);
+            return true;
         }
         catch (SQLite::Exception e)
         {
             spdlog::get("exchange")->log(spdlog::level::err, e.what());
-            return;
+            return false;
         }
     }
 
-    auto Exchange::request_step(Wallet& wallet, SQLite::Transaction& transaction, RequestSideInfo const& buyer_info,
-                                RequestSideInfo const& seller_info, float const price) -> void
+    auto Exchange::save_snapshot(std::filesystem::path const& path) -> bool
     {
-        auto const buyer_wallets = wallet.wallets(buyer_info.user_id).value();
+        // Only committed events may be part of a snapshot
+        if (!m_journal || !m_journal->commit())
+        {
+            return false;
+        }
 
-        auto buyer_wallet_from = std::find_if(buyer_wallets.begin(), buyer_wallets.end(), [&](auto const& element) {
-            return element.currency.compare(seller_info.currency) == 0;
-        });
+        Snapshot snapshot{.sequence = m_journal->committed_sequence(), .last_request_id = m_last_request_id};
+        for (auto const& [instrument, book] : m_books)
+        {
+            book.for_each([&, instrument](Order const& order) {
+                snapshot.orders.emplace_back(SnapshotOrder{.instrument = instrument, .order = order});
+            });
+        }
 
-        auto buyer_wallet_to = std::find_if(buyer_wallets.begin(), buyer_wallets.end(), [&](auto const& element) {
-            return element.currency.compare(buyer_info.currency) == 0;
-        });
+        if (!snapshot.save(path))
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Snapshot {} cannot be saved", path.string());
+            return false;
+        }
+        return true;
+    }
 
-        auto const seller_wallets = wallet.wallets(seller_info.user_id).value();
+    auto Exchange::pool_stats() const -> OrderPool::Stats
+    {
+        return m_pool.stats();
+    }
 
-        auto seller_wallet_from = std::find_if(seller_wallets.begin(), seller_wallets.end(), [&](auto const& element) {
-            return element.currency.compare(buyer_info.currency) == 0;
-        });
+    auto Exchange::statement_stats() const -> StatementCache::Stats
+    {
+        return m_statements.stats();
+    }
 
-        auto seller_wallet_to = std::find_if(seller_wallets.begin(), seller_wallets.end(), [&](auto const& element) {
-            return element.currency.compare(seller_info.currency) == 0;
-        });
+    auto Exchange::load_requests() -> void
+    {
+        try
+        {
+            // Requests of other instruments belong to other engines and are left alone
+            for (auto& [instrument, book] : m_books)
+            {
+                this->load_book(instrument, book);
+            }
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
 
-        bool const buyer_amount_beq = buyer_info.amount >= seller_info.amount;
-        float const diff_amount = buyer_amount_beq ? seller_info.amount : buyer_info.amount;
+    auto Exchange::load_book(core::InstrumentId const instrument, OrderBook& book, uint64_t const after) -> void
+    {
+        std::string const currency(core::find_instrument(instrument)->name);
+        {
+            auto statement = m_statements.prepare("SELECT COUNT(*) FROM requests WHERE currency = ? AND id > ?");
+            statement->bind(1, currency);
+            statement->bind(2, static_cast<int64_t>(after));
+            if (statement->executeStep())
+            {
+                m_pool.reserve(statement->getColumn(0).getInt64());
+            }
+        }
 
-        if (!wallet.make_transaction(buyer_wallet_from->id, diff_amount * price, WalletTransactionType::Withdraw,
-                                     "Exchange actions"))
+        auto statement = m_statements.prepare("SELECT id, user_id, amount, price, request_type "
+                                              "FROM requests WHERE currency = ? AND id > ? ORDER BY id ASC");
+        statement->bind(1, currency);
+        statement->bind(2, static_cast<int64_t>(after));
+
+        while (statement->executeStep())
+        {
+            m_last_request_id = std::max<uint64_t>(m_last_request_id, statement->getColumn(0).getInt64());
+            book.insert(Order{.request_id = static_cast<uint64_t>(statement->getColumn(0).getInt64()),
+                              .user_id = static_cast<uint64_t>(statement->getColumn(1).getInt64()),
+                              .amount = statement->getColumn(2).getInt64(),
+                              .price = statement->getColumn(3).getInt64(),
+                              .request_type = static_cast<RequestType>(statement->getColumn(4).getUInt())});
+        }
+    }
+
+    auto Exchange::upgrade_requests() -> void
+    {
+        try
+        {
+            bool is_real = false;
+            {
+                SQLite::Statement statement(*m_database,
+                                            "SELECT type FROM pragma_table_info('requests') WHERE name = 'amount'");
+                is_real = statement.executeStep() && statement.getColumn(0).getString() == "REAL";
+            }
+
+            // Ids of deleted requests were reused before, which journal and snapshot recovery cannot tell apart
+            bool is_autoincrement = false;
+            {
+                SQLite::Statement statement(*m_database, "SELECT sql FROM sqlite_master WHERE type = 'table' AND "
+                                                         "name = 'requests'");
+                is_autoincrement =
+                    statement.executeStep() && statement.getColumn(0).getString().find("AUTOINCREMENT") !=
+                                                   std::string::npos;
+            }
+
+            if (!is_real && is_autoincrement)
+            {
+                return;
+            }
+
+            SQLite::Transaction transaction(*m_database);
+            m_database->exec("ALTER TABLE requests RENAME TO requests_legacy");
+            m_database->exec("CREATE TABLE requests (id INTEGER PRIMARY KEY AUTOINCREMENT, user_id INTEGER, "
+                             "currency TEXT, amount INTEGER, price INTEGER, request_type INTEGER)");
+
+            if (is_real)
+            {
+                // Requests were stored as REAL before amounts and prices became fixed-point
+                for (auto const& instrument : core::instruments)
+                {
+                    SQLite::Statement statement(
+                        *m_database, "INSERT INTO requests SELECT id, user_id, currency, "
+                                     "CAST(ROUND(amount * ?) AS INTEGER), CAST(ROUND(price * ?) AS INTEGER), "
+                                     "request_type FROM requests_legacy WHERE currency = ?");
+                    statement.bind(1, core::pow10(instrument.amount_scale));
+                    statement.bind(2, core::pow10(instrument.price_scale));
+                    statement.bind(3, std::string(instrument.name));
+                    statement.exec();
+                }
+            }
+            else
+            {
+                m_database->exec("INSERT INTO requests SELECT * FROM requests_legacy");
+            }
+
+            m_database->exec("DROP TABLE requests_legacy");
+            transaction.commit();
+
+            spdlog::get("exchange")->log(spdlog::level::info, is_real
+                                                                  ? "Requests were converted to fixed-point amounts"
+                                                                  : "Request ids are no longer reused");
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    auto Exchange::fill_handler(Wallet& wallet, core::InstrumentInfo const& instrument) -> OrderBook::FillHandler
+    {
+        return [this, &wallet, &instrument](Order const& buyer, Order const& seller, int64_t const amount,
+                                            int64_t const price) -> bool {
+            if (m_journal)
+            {
+                // The fill is only applied after it is journaled, when it can no longer be rolled back. Requests
+                // accepted before their owner had wallets are stopped here
+                if (!this->has_wallets(wallet, instrument, buyer.user_id) ||
+                    !this->has_wallets(wallet, instrument, seller.user_id))
+                {
+                    spdlog::get("exchange")->log(spdlog::level::err,
+                                                 "Wallets of user_id: {} or user_id: {} were not found",
+                                                 buyer.user_id, seller.user_id);
+                    return false;
+                }
+
+                JournalEvent const event{.type = JournalEventType::Fill,
+                                         .instrument = instrument.id,
+                                         .request_type = RequestType::Buy,
+                                         .request_id = buyer.request_id,
+                                         .user_id = buyer.user_id,
+                                         .amount = amount,
+                                         .price = price,
+                                         .counter_request_id = seller.request_id,
+                                         .counter_user_id = seller.user_id,
+                                         .request_amount = buyer.amount,
+                                         .counter_amount = seller.amount};
+                m_journal->append(event);
+                m_pending_events.emplace_back(event);
+                this->report(this->executions(instrument, buyer, seller, amount, price));
+                return true;
+            }
+
+            // A failed fill is reported to the book rather than thrown through it, so the book is left as the
+            // rolled back tables are
+            try
+            {
+                auto const [buyer_info, seller_info] = this->side_infos(instrument, buyer, seller);
+                // Other engines write to the same database, so the write lock is taken before any reads
+                SQLite::Transaction transaction(*m_database, SQLite::TransactionBehavior::IMMEDIATE);
+                if (!this->request_step(wallet, transaction, instrument, buyer_info, seller_info, amount, price))
+                {
+                    return false;
+                }
+
+                transaction.commit();
+                this->report(this->executions(instrument, buyer, seller, amount, price));
+                return true;
+            }
+            catch (SQLite::Exception e)
+            {
+                spdlog::get("exchange")->log(spdlog::level::err, e.what());
+                return false;
+            }
+        };
+    }
+
+    auto Exchange::side_infos(core::InstrumentInfo const& instrument, Order const& buyer, Order const& seller)
+        -> std::pair<RequestSideInfo, RequestSideInfo>
+    {
+        return {RequestSideInfo{.request_id = buyer.request_id,
+                                .user_id = buyer.user_id,
+                                .amount = buyer.amount,
+                                .currency = instrument.base},
+                RequestSideInfo{.request_id = seller.request_id,
+                                .user_id = seller.user_id,
+                                .amount = seller.amount,
+                                .currency = instrument.quote}};
+    }
+
+    auto Exchange::executions(core::InstrumentInfo const& instrument, Order const& buyer, Order const& seller,
+                              int64_t const amount, int64_t const price) -> std::array<Execution, 2>
+    {
+        // The book passes both requests as they were before the fill
+        return {Execution{.instrument = instrument.id,
+                          .request_id = buyer.request_id,
+                          .user_id = buyer.user_id,
+                          .request_type = RequestType::Buy,
+                          .amount = amount,
+                          .price = price,
+                          .remaining = buyer.amount - amount},
+                Execution{.instrument = instrument.id,
+                          .request_id = seller.request_id,
+                          .user_id = seller.user_id,
+                          .request_type = RequestType::Sell,
+                          .amount = amount,
+                          .price = price,
+                          .remaining = seller.amount - amount}};
+    }
+
+    auto Exchange::report(std::span<Execution const> const executions) -> void
+    {
+        if (!on_execution)
         {
-            transaction.rollback();
             return;
         }
 
-        if (!wallet.make_transaction(buyer_wallet_to->id, diff_amount, WalletTransactionType::Deposit,
-                                     "Exchange actions"))
+        for (auto const& execution : executions)
+        {
+            on_execution(execution);
+        }
+    }
+
+    auto Exchange::has_wallets(Wallet& wallet, core::InstrumentInfo const& instrument, uint64_t const user_id) -> bool
+    {
+        uint64_t wallet_id;
+        return wallet.find_wallet(user_id, instrument.base, wallet_id) &&
+               wallet.find_wallet(user_id, instrument.quote, wallet_id);
+    }
+
+    auto Exchange::request_step(Wallet& wallet, SQLite::Transaction& transaction,
+                                core::InstrumentInfo const& instrument, RequestSideInfo const& buyer_info,
+                                RequestSideInfo const& seller_info, int64_t const amount, int64_t const price) -> bool
+    {
+        uint64_t buyer_wallet_from, buyer_wallet_to, seller_wallet_from, seller_wallet_to;
+        if (!wallet.find_wallet(buyer_info.user_id, seller_info.currency, buyer_wallet_from) ||
+            !wallet.find_wallet(buyer_info.user_id, buyer_info.currency, buyer_wallet_to) ||
+            !wallet.find_wallet(seller_info.user_id, buyer_info.currency, seller_wallet_from) ||
+            !wallet.find_wallet(seller_info.user_id, seller_info.currency, seller_wallet_to))
         {
+            spdlog::get("exchange")->log(spdlog::level::err, "Wallets of user_id: {} or user_id: {} were not found",
+                                         buyer_info.user_id, seller_info.user_id);
             transaction.rollback();
-            return;
+            return false;
         }
 
-        if (!wallet.make_transaction(seller_wallet_from->id, diff_amount, WalletTransactionType::Withdraw,
+        auto const notional = core::notional(instrument, amount, price);
+        if (!notional)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, "Fill of {} at {} is too large", amount, price);
+            transaction.rollback();
+            return false;
+        }
+        int64_t const total = notional.value();
+
+        if (!wallet.make_transaction(buyer_wallet_from, total, WalletTransactionType::Withdraw,
                                      "Exchange actions"))
         {
             transaction.rollback();
-            return;
+            return false;
         }
 
-        if (!wallet.make_transaction(seller_wallet_to->id, diff_amount * price, WalletTransactionType::Deposit,
+        if (!wallet.make_transaction(buyer_wallet_to, amount, WalletTransactionType::Deposit, "Exchange actions"))
+        {
+            transaction.rollback();
+            return false;
+        }
+
+        if (!wallet.make_transaction(seller_wallet_from, amount, WalletTransactionType::Withdraw,
                                      "Exchange actions"))
         {
             transaction.rollback();
-            return;
+            return false;
         }
 
+        if (!wallet.make_transaction(seller_wallet_to, total, WalletTransactionType::Deposit,
+                                     "Exchange actions"))
         {
-            SQLite::Statement statement(*m_database, "DELETE FROM requests WHERE id = ?");
-            statement.bind(1, static_cast<int64_t>(buyer_info.request_id));
-            if (statement.exec() == 0)
-            {
-                transaction.rollback();
-                return;
-            }
+            transaction.rollback();
+            return false;
         }
 
-        if (buyer_amount_beq)
+        for (auto const& side_info : {buyer_info, seller_info})
         {
-            SQLite::Statement statement(*m_database, "DELETE FROM requests WHERE id = ?");
-            statement.bind(1, static_cast<int64_t>(seller_info.request_id));
-            if (statement.exec() == 0)
+            int64_t const remaining = side_info.amount - amount;
+            if (remaining == 0)
             {
-                transaction.rollback();
-                return;
+                auto statement = m_statements.prepare("DELETE FROM requests WHERE id = ?");
+                statement->bind(1, static_cast<int64_t>(side_info.request_id));
+                if (statement->exec() == 0)
+                {
+                    transaction.rollback();
+                    return false;
+                }
             }
-        }
-        else
-        {
-            SQLite::Statement statement(*m_database, "UPDATE requests SET amount = ? WHERE id = ?");
-            statement.bind(1, seller_info.amount - diff_amount);
-            statement.bind(2, static_cast<int64_t>(seller_info.request_id));
-            if (statement.exec() == 0)
+            else
             {
-                transaction.rollback();
-                return;
+                auto statement = m_statements.prepare("UPDATE requests SET amount = ? WHERE id = ?");
+                statement->bind(1, remaining);
+                statement->bind(2, static_cast<int64_t>(side_info.request_id));
+                if (statement->exec() == 0)
+                {
+                    transaction.rollback();
+                    return false;
+                }
             }
         }
 
-        transaction.commit();
+        std::string const amount_text = core::Decimal(amount, instrument.amount_scale).to_string();
+        std::string const price_text = core::Decimal(price, instrument.price_scale).to_string();
 
         spdlog::get("exchange")
             ->log(spdlog::level::debug,
-                  "Request from user_id: {} completed: currency: {}/{}, type: buy, "
+                  "Request from user_id: {} completed: currency: {}, type: buy, "
                   "amount: {}, price: {}",
-                  buyer_info.user_id, buyer_info.currency, seller_info.currency, diff_amount, price);
+                  buyer_info.user_id, instrument.name, amount_text, price_text);
 
         spdlog::get("exchange")
             ->log(spdlog::level::debug,
-                  "Request from user_id: {} completed: currency: {}/{}, type: sell, "
+                  "Request from user_id: {} completed: currency: {}, type: sell, "
                   "amount: {}, price: {}",
-                  seller_info.user_id, buyer_info.currency, seller_info.currency, diff_amount, price);
+                  seller_info.user_id, instrument.name, amount_text, price_text);
+        return true;
+    }
+
+    auto Exchange::apply_events(Wallet& wallet, std::span<JournalEvent const> const events, uint64_t const sequence)
+        -> bool
+    {
+        try
+        {
+            SQLite::Transaction transaction(*m_database, SQLite::TransactionBehavior::IMMEDIATE);
+            for (auto const& event : events)
+            {
+                if (!this->apply_event(wallet, transaction, event))
+                {
+                    return false;
+                }
+            }
+
+            // The applied sequence commits with the events, so a replay never applies them twice
+            auto statement = m_statements.prepare("INSERT INTO journals (path, sequence) VALUES (?, ?) "
+                                                  "ON CONFLICT (path) DO UPDATE SET sequence = excluded.sequence");
+            statement->bind(1, m_journal->path().string());
+            statement->bind(2, static_cast<int64_t>(sequence));
+            statement->exec();
+
+            transaction.commit();
+            return true;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::err, e.what());
+            return false;
+        }
+    }
+
+    auto Exchange::apply_event(Wallet& wallet, SQLite::Transaction& transaction, JournalEvent const& event) -> bool
+    {
+        auto const instrument = core::find_instrument(event.instrument);
+        if (!instrument)
+        {
+            transaction.rollback();
+            return false;
+        }
+
+        switch (event.type)
+        {
+            case JournalEventType::OrderAccepted: {
+                // The row is inserted before the request is journaled, but that commit may be lost while the
+                // journal is kept. The explicit id also moves the AUTOINCREMENT sequence past it
+                auto statement = m_statements.prepare("INSERT OR IGNORE INTO requests (id, user_id, currency, amount, "
+                                                      "price, request_type) VALUES (?, ?, ?, ?, ?, ?)");
+                statement->bind(1, static_cast<int64_t>(event.request_id));
+                statement->bind(2, static_cast<int64_t>(event.user_id));
+                statement->bind(3, std::string(instrument->name));
+                statement->bind(4, event.amount);
+                statement->bind(5, event.price);
+                statement->bind(6, static_cast<uint32_t>(event.request_type));
+                statement->exec();
+                return true;
+            }
+            case JournalEventType::OrderCancelled: {
+                auto statement = m_statements.prepare("DELETE FROM requests WHERE id = ?");
+                statement->bind(1, static_cast<int64_t>(event.request_id));
+                statement->exec();
+                return true;
+            }
+            case JournalEventType::Fill: {
+                RequestSideInfo const buyer_info{.request_id = event.request_id,
+                                                 .user_id = event.user_id,
+                                                 .amount = event.request_amount,
+                                                 .currency = instrument->base};
+                RequestSideInfo const seller_info{.request_id = event.counter_request_id,
+                                                  .user_id = event.counter_user_id,
+                                                  .amount = event.counter_amount,
+                                                  .currency = instrument->quote};
+                return this->request_step(wallet, transaction, *instrument, buyer_info, seller_info, event.amount,
+                                          event.price);
+            }
+        }
+        return false;
+    }
+
+    auto Exchange::restore_event(JournalEvent const& event) -> void
+    {
+        auto book = m_books.find(event.instrument);
+        if (book == m_books.end())
+        {
+            return;
+        }
+
+        switch (event.type)
+        {
+            case JournalEventType::OrderAccepted: {
+                m_last_request_id = std::max(m_last_request_id, event.request_id);
+                book->second.insert(Order{.request_id = event.request_id,
+                                          .user_id = event.user_id,
+                                          .amount = event.amount,
+                                          .price = event.price,
+                                          .request_type = event.request_type});
+                break;
+            }
+            case JournalEventType::OrderCancelled: {
+                book->second.erase(event.request_id);
+                break;
+            }
+            case JournalEventType::Fill: {
+                book->second.reduce(event.request_id, event.amount);
+                book->second.reduce(event.counter_request_id, event.amount);
+                break;
+            }
+        }
     }
-} // namespace exchange::modules
\ No newline at end of file
+} // namespace exchange::modules
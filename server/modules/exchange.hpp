@@ -1,43 +1,128 @@
 #pragma once
 
+#include "core/instrument.hpp"
+#include "journal.hpp"
+#include "order_book.hpp"
+#include "order_pool.hpp"
+#include "snapshot.hpp"
+#include "statement_cache.hpp"
 #include <SQLiteCpp/SQLiteCpp.h>
 
 namespace exchange::modules
 {
-    enum class RequestType : uint32_t
+    class Wallet;
+
+    // One side of a fill, as reported to the owner of the request
+    struct Execution
     {
-        Buy,
-        Sell
+        core::InstrumentId instrument;
+        uint64_t request_id;
+        uint64_t user_id;
+        RequestType request_type;
+        int64_t amount;
+        int64_t price;
+        int64_t remaining;
     };
 
-    class Wallet;
-
     class Exchange
     {
       public:
-        Exchange(SQLite::Database& database, std::optional<std::filesystem::path> const log_path);
+        using ExecutionHandler = std::function<void(Execution const&)>;
+
+        Exchange(SQLite::Database& database, std::optional<std::filesystem::path> const log_path,
+                 std::span<core::InstrumentInfo const> const instruments = core::instruments,
+                 Journal* const journal = nullptr);
 
         ~Exchange();
 
-        auto make_request(uint64_t const user_id, std::string_view const currency, float const amount,
-                          float const price, RequestType const request_type) -> bool;
+        auto make_request(uint64_t const user_id, core::InstrumentId const instrument, int64_t const amount,
+                          int64_t const price, RequestType const request_type) -> bool;
 
         auto remove_request(uint64_t const request_id) -> bool;
 
-        auto process_requests(Wallet& wallet) -> void;
+        auto submit_order(Wallet& wallet, uint64_t const user_id, core::InstrumentId const instrument,
+                          int64_t const amount, int64_t const price, RequestType const request_type,
+                          uint64_t& request_id) -> bool;
+
+        auto cancel_request(uint64_t const user_id, uint64_t const request_id) -> bool;
+
+        auto flush_cancels() -> bool;
+
+        // False when a fill was rolled back
+        auto process_requests(Wallet& wallet) -> bool;
+
+        auto begin_auction(core::InstrumentId const instrument) -> bool;
+
+        auto uncross(Wallet& wallet, core::InstrumentId const instrument) -> bool;
+
+        auto commit_journal(Wallet& wallet) -> bool;
+
+        // Fills and cancels appended to the journal since the last call, for a writer to apply
+        auto take_journal_events() -> std::vector<JournalEvent>;
+
+        // Applies journaled events and records the journal sequence they reach, in one transaction
+        auto apply_events(Wallet& wallet, std::span<JournalEvent const> const events, uint64_t const sequence)
+            -> bool;
+
+        auto replay_journal(Wallet& wallet,
+                            std::optional<std::filesystem::path> const& snapshot_path = std::nullopt) -> bool;
+
+        auto save_snapshot(std::filesystem::path const& path) -> bool;
+
+        auto pool_stats() const -> OrderPool::Stats;
+
+        auto statement_stats() const -> StatementCache::Stats;
+
+        // Called for both sides of every fill once it is journaled or committed, fills that were rolled back are
+        // not reported
+        ExecutionHandler on_execution;
 
       private:
         SQLite::Database* m_database;
+        StatementCache m_statements;
+        OrderPool m_pool;
+        std::unordered_map<core::InstrumentId, OrderBook> m_books;
+        std::vector<uint64_t> m_cancelled_requests;
+        std::unordered_set<core::InstrumentId> m_auctions;
+        uint64_t m_last_request_id;
+
+        // With a journal, fills and cancels reach the database only after the journal has made them durable
+        Journal* m_journal;
+        std::vector<JournalEvent> m_pending_events;
 
         struct RequestSideInfo
         {
             uint64_t request_id;
             uint64_t user_id;
-            float amount;
-            std::string currency;
+            int64_t amount;
+            core::CurrencyId currency;
         };
 
-        auto request_step(Wallet& wallet, SQLite::Transaction& transaction, RequestSideInfo const& buyer_info,
-                          RequestSideInfo const& seller_info, float const price) -> void;
+        auto load_requests() -> void;
+
+        auto load_book(core::InstrumentId const instrument, OrderBook& book, uint64_t const after = 0) -> void;
+
+        auto upgrade_requests() -> void;
+
+        auto fill_handler(Wallet& wallet, core::InstrumentInfo const& instrument) -> OrderBook::FillHandler;
+
+        auto side_infos(core::InstrumentInfo const& instrument, Order const& buyer, Order const& seller)
+            -> std::pair<RequestSideInfo, RequestSideInfo>;
+
+        auto executions(core::InstrumentInfo const& instrument, Order const& buyer, Order const& seller,
+                        int64_t const amount, int64_t const price) -> std::array<Execution, 2>;
+
+        auto report(std::span<Execution const> const executions) -> void;
+
+        // Whether the user has a wallet in both currencies of the instrument, found through the wallet cache
+        auto has_wallets(Wallet& wallet, core::InstrumentInfo const& instrument, uint64_t const user_id) -> bool;
+
+        auto request_step(Wallet& wallet, SQLite::Transaction& transaction, core::InstrumentInfo const& instrument,
+                          RequestSideInfo const& buyer_info, RequestSideInfo const& seller_info, int64_t const amount,
+                          int64_t const price) -> bool;
+
+        auto apply_event(Wallet& wallet, SQLite::Transaction& transaction, JournalEvent const& event) -> bool;
+
+        auto restore_event(JournalEvent const& event) -> void;
     };
 } // namespace exchange::modules
\ No newline at end of file
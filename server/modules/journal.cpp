@@ -0,0 +1,306 @@
+#include "journal.hpp"
+#include "core/binary.hpp"
+#include "precompiled.hpp"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace exchange::modules
+{
+    // Every record is the payload size, a CRC-32 of the sequence and payload, the sequence and the payload
+    constexpr size_t record_header_size = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+    constexpr size_t record_payload_size = 68;
+    constexpr size_t record_size = record_header_size + record_payload_size;
+
+    namespace
+    {
+        // Reads the record at the current position, a torn or corrupted record reads as the end of the journal
+        auto read_record(std::FILE* file, uint64_t& sequence, JournalEvent& event) -> bool
+        {
+            std::array<uint8_t, record_size> record;
+            if (std::fread(record.data(), 1, record.size(), file) != record.size())
+            {
+                return false;
+            }
+
+            size_t offset = 0;
+            uint32_t const payload_size = core::get_integer<uint32_t>(record, offset).value();
+            uint32_t const record_checksum = core::get_integer<uint32_t>(record, offset).value();
+            if (payload_size != record_payload_size ||
+                record_checksum != core::crc32(std::span(record).subspan(sizeof(uint32_t) * 2)))
+            {
+                return false;
+            }
+
+            sequence = core::get_integer<uint64_t>(record, offset).value();
+            event.type = static_cast<JournalEventType>(core::get_integer<uint8_t>(record, offset).value());
+            event.instrument = core::get_integer<core::InstrumentId>(record, offset).value();
+            event.request_type = static_cast<RequestType>(core::get_integer<uint8_t>(record, offset).value());
+            event.request_id = core::get_integer<uint64_t>(record, offset).value();
+            event.user_id = core::get_integer<uint64_t>(record, offset).value();
+            event.amount = core::get_integer<int64_t>(record, offset).value();
+            event.price = core::get_integer<int64_t>(record, offset).value();
+            event.counter_request_id = core::get_integer<uint64_t>(record, offset).value();
+            event.counter_user_id = core::get_integer<uint64_t>(record, offset).value();
+            event.request_amount = core::get_integer<int64_t>(record, offset).value();
+            event.counter_amount = core::get_integer<int64_t>(record, offset).value();
+            return true;
+        }
+
+        // Records have a fixed size, so the record at an index is found without reading the ones before it.
+        // Offsets past 2 GiB do not fit the long of std::fseek everywhere, so the 64-bit variants are used, and
+        // an offset their type cannot hold either is refused
+        auto seek_record(std::FILE* file, uintmax_t const index) -> bool
+        {
+#ifdef _WIN32
+            using Offset = __int64;
+#else
+            using Offset = off_t;
+#endif
+            if (index > static_cast<uintmax_t>(std::numeric_limits<Offset>::max()) / record_size)
+            {
+                return false;
+            }
+#ifdef _WIN32
+            return _fseeki64(file, static_cast<Offset>(index * record_size), SEEK_SET) == 0;
+#else
+            return fseeko(file, static_cast<Offset>(index * record_size), SEEK_SET) == 0;
+#endif
+        }
+
+        auto read_record_at(std::FILE* file, uintmax_t const index, uint64_t& sequence, JournalEvent& event) -> bool
+        {
+            return seek_record(file, index) && read_record(file, sequence, event);
+        }
+    } // namespace
+
+    Journal::Journal(std::filesystem::path const& path, std::optional<std::filesystem::path> const log_path)
+        : m_path(path), m_file(nullptr), m_first_sequence(0), m_sequence(0), m_committed_size(0),
+          m_committed_sequence(0)
+    {
+        // Every matching engine owns its own journal, and they all share one logger
+        if (!spdlog::get("journal"))
+        {
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("journal", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
+        }
+
+        m_sequence = m_committed_sequence = this->recover();
+
+        m_file = std::fopen(m_path.string().c_str(), "ab");
+        if (!m_file)
+        {
+            spdlog::get("journal")->log(spdlog::level::critical, "Journal {} cannot be opened", m_path.string());
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Commits are written as one block already, and a failed write must not stay behind in a stdio buffer
+        std::setvbuf(m_file, nullptr, _IONBF, 0);
+    }
+
+    Journal::~Journal()
+    {
+        this->commit();
+        std::fclose(m_file);
+    }
+
+    auto Journal::append(JournalEvent const& event) -> uint64_t
+    {
+        std::lock_guard lock(m_mutex);
+        size_t const offset = m_buffer.size();
+        core::put_integer<uint32_t>(m_buffer, record_payload_size);
+        core::put_integer<uint32_t>(m_buffer, 0);
+        core::put_integer<uint64_t>(m_buffer, ++m_sequence);
+        if (m_first_sequence == 0)
+        {
+            m_first_sequence = m_sequence;
+        }
+        core::put_integer<uint8_t>(m_buffer, static_cast<uint8_t>(event.type));
+        core::put_integer<core::InstrumentId>(m_buffer, event.instrument);
+        core::put_integer<uint8_t>(m_buffer, static_cast<uint8_t>(event.request_type));
+        core::put_integer<uint64_t>(m_buffer, event.request_id);
+        core::put_integer<uint64_t>(m_buffer, event.user_id);
+        core::put_integer<int64_t>(m_buffer, event.amount);
+        core::put_integer<int64_t>(m_buffer, event.price);
+        core::put_integer<uint64_t>(m_buffer, event.counter_request_id);
+        core::put_integer<uint64_t>(m_buffer, event.counter_user_id);
+        core::put_integer<int64_t>(m_buffer, event.request_amount);
+        core::put_integer<int64_t>(m_buffer, event.counter_amount);
+
+        auto const record = std::span(m_buffer).subspan(offset);
+        uint32_t const record_checksum = core::crc32(record.subspan(sizeof(uint32_t) * 2));
+        for (size_t i = 0; i < sizeof(uint32_t); ++i)
+        {
+            record[sizeof(uint32_t) + i] = static_cast<uint8_t>(record_checksum >> (i * 8));
+        }
+        return m_sequence;
+    }
+
+    auto Journal::commit() -> bool
+    {
+        std::lock_guard commit_lock(m_commit_mutex);
+
+        uint64_t sequence;
+        {
+            std::lock_guard lock(m_mutex);
+            sequence = m_sequence;
+            if (m_committed_sequence == sequence)
+            {
+                return true;
+            }
+            m_commit_buffer.clear();
+            std::swap(m_commit_buffer, m_buffer);
+        }
+
+        // One write and one sync make every event appended since the last commit durable
+        if (!m_commit_buffer.empty())
+        {
+            if (std::fwrite(m_commit_buffer.data(), 1, m_commit_buffer.size(), m_file) != m_commit_buffer.size() ||
+                std::fflush(m_file) != 0)
+            {
+                spdlog::get("journal")->log(spdlog::level::err, "Journal {} cannot be written", m_path.string());
+
+                // Whatever part of the block was written is cut off, so the retry appends it whole after the
+                // last committed record
+#ifdef _WIN32
+                bool const truncated = _chsize_s(_fileno(m_file), m_committed_size) == 0;
+#else
+                bool const truncated = ftruncate(fileno(m_file), static_cast<off_t>(m_committed_size)) == 0;
+#endif
+                if (!truncated)
+                {
+                    spdlog::get("journal")->log(spdlog::level::critical, "Journal {} cannot be truncated",
+                                                m_path.string());
+                    std::exit(EXIT_FAILURE);
+                }
+                std::clearerr(m_file);
+
+                // Events appended meanwhile follow the ones that were not written
+                std::lock_guard lock(m_mutex);
+                m_buffer.insert(m_buffer.begin(), m_commit_buffer.begin(), m_commit_buffer.end());
+                return false;
+            }
+        }
+
+        // After a failed sync the written pages may already be dropped, so nothing written since the last
+        // sync can be trusted to be on disk and no retry can tell
+#ifdef _WIN32
+        bool const synced = _commit(_fileno(m_file)) == 0;
+#else
+        bool const synced = fdatasync(fileno(m_file)) == 0;
+#endif
+        if (!synced)
+        {
+            spdlog::get("journal")->log(spdlog::level::critical, "Journal {} cannot be synced", m_path.string());
+            std::exit(EXIT_FAILURE);
+        }
+
+        m_committed_size += m_commit_buffer.size();
+        m_committed_sequence = sequence;
+        return true;
+    }
+
+    auto Journal::replay(uint64_t const after, EventHandler const& on_event) const -> bool
+    {
+        std::FILE* file = std::fopen(m_path.string().c_str(), "rb");
+        if (!file)
+        {
+            return false;
+        }
+
+        // Sequences are contiguous, so the tail is reached directly however long the journal is
+        uint64_t const first_sequence = [this]() {
+            std::lock_guard lock(m_mutex);
+            return m_first_sequence;
+        }();
+        uintmax_t const index = first_sequence != 0 && after >= first_sequence ? after - first_sequence + 1 : 0;
+        if (!seek_record(file, index))
+        {
+            std::fclose(file);
+            return false;
+        }
+
+        uint64_t sequence;
+        JournalEvent event;
+        while (read_record(file, sequence, event))
+        {
+            if (sequence > after && !on_event(sequence, event))
+            {
+                std::fclose(file);
+                return false;
+            }
+        }
+        std::fclose(file);
+        return true;
+    }
+
+    auto Journal::sequence() const -> uint64_t
+    {
+        std::lock_guard lock(m_mutex);
+        return m_sequence;
+    }
+
+    auto Journal::committed_sequence() const -> uint64_t
+    {
+        return m_committed_sequence;
+    }
+
+    auto Journal::path() const -> std::filesystem::path const&
+    {
+        return m_path;
+    }
+
+    auto Journal::recover() -> uint64_t
+    {
+        std::FILE* file = std::fopen(m_path.string().c_str(), "rb");
+        if (!file)
+        {
+            return 0;
+        }
+
+        uintmax_t const file_size = std::filesystem::file_size(m_path);
+        uintmax_t records = file_size / record_size;
+
+        // Usually only the last record can be torn, which the first and last full records tell apart
+        uint64_t first_sequence = 0;
+        uint64_t last_sequence = 0;
+        JournalEvent event;
+        if (records == 0 || !read_record_at(file, 0, first_sequence, event) ||
+            !read_record_at(file, records - 1, last_sequence, event) ||
+            last_sequence != first_sequence + records - 1)
+        {
+            std::fseek(file, 0, SEEK_SET);
+
+            records = 0;
+            uint64_t sequence;
+            while (read_record(file, sequence, event) && (records == 0 || sequence == last_sequence + 1))
+            {
+                first_sequence = records == 0 ? sequence : first_sequence;
+                last_sequence = sequence;
+                ++records;
+            }
+        }
+        std::fclose(file);
+
+        m_first_sequence = records > 0 ? first_sequence : 0;
+        last_sequence = records > 0 ? last_sequence : 0;
+
+        // A record torn by a crash was never committed, so it is cut off before new ones are appended
+        uintmax_t const valid_size = records * record_size;
+        if (file_size != valid_size)
+        {
+            spdlog::get("journal")->log(spdlog::level::warn, "Journal {} is truncated after sequence {}",
+                                        m_path.string(), last_sequence);
+            std::filesystem::resize_file(m_path, valid_size);
+        }
+        m_committed_size = valid_size;
+        return last_sequence;
+    }
+} // namespace exchange::modules
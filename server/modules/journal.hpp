@@ -0,0 +1,76 @@
+#pragma once
+
+#include "core/instrument.hpp"
+#include "order_book.hpp"
+
+namespace exchange::modules
+{
+    enum class JournalEventType : uint8_t
+    {
+        OrderAccepted,
+        OrderCancelled,
+        Fill
+    };
+
+    // Fills name the buyer first and the seller as the counter side, with the amounts both requests had before it
+    struct JournalEvent
+    {
+        JournalEventType type;
+        core::InstrumentId instrument;
+        RequestType request_type;
+        uint64_t request_id;
+        uint64_t user_id;
+        int64_t amount;
+        int64_t price;
+        uint64_t counter_request_id;
+        uint64_t counter_user_id;
+        int64_t request_amount;
+        int64_t counter_amount;
+    };
+
+    // Append-only file of checksummed events, appended events become durable together on commit.
+    // The matching thread appends while the writer thread commits, so both may run at the same time
+    class Journal
+    {
+      public:
+        using EventHandler = std::function<bool(uint64_t const sequence, JournalEvent const& event)>;
+
+        Journal(std::filesystem::path const& path, std::optional<std::filesystem::path> const log_path);
+
+        Journal(Journal const& other) = delete;
+
+        ~Journal();
+
+        auto operator=(Journal const& other) -> Journal& = delete;
+
+        auto append(JournalEvent const& event) -> uint64_t;
+
+        // A failed write leaves the events to the next commit, a failed sync ends the process
+        auto commit() -> bool;
+
+        auto replay(uint64_t const after, EventHandler const& on_event) const -> bool;
+
+        auto sequence() const -> uint64_t;
+
+        auto committed_sequence() const -> uint64_t;
+
+        auto path() const -> std::filesystem::path const&;
+
+      private:
+        std::filesystem::path m_path;
+        std::FILE* m_file;
+
+        mutable std::mutex m_mutex;
+        std::vector<uint8_t> m_buffer;
+        uint64_t m_first_sequence;
+        uint64_t m_sequence;
+
+        // Commits write one after another, from a buffer swapped out so appends do not wait for the sync
+        std::mutex m_commit_mutex;
+        std::vector<uint8_t> m_commit_buffer;
+        uintmax_t m_committed_size;
+        std::atomic<uint64_t> m_committed_sequence;
+
+        auto recover() -> uint64_t;
+    };
+} // namespace exchange::modules
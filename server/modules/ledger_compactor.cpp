@@ -0,0 +1,186 @@
+#include "ledger_compactor.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    // The compactor shares the file with the engines, so it waits for their writes instead of failing
+    constexpr int32_t compaction_busy_timeout = 5000;
+
+    LedgerCompactor::LedgerCompactor(StorageBackend const& storage, CompactionSettings const& settings,
+                                     std::optional<std::filesystem::path> const log_path)
+        : m_database(storage.open(compaction_busy_timeout)), m_settings(settings),
+          m_work_guard(boost::asio::make_work_guard(m_io_context)), m_timer(m_io_context)
+    {
+        if (!spdlog::get("storage"))
+        {
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("storage", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
+        }
+
+        try
+        {
+            // Compactions are not journaled either
+            storage.settings().apply_unjournaled(m_database);
+
+            {
+                SQLite::Statement statement(m_database, "ATTACH DATABASE ? AS archive");
+                statement.bind(1, m_settings.archive_path.string());
+                statement.exec();
+            }
+            m_database.exec("CREATE TABLE IF NOT EXISTS archive.transactions (id INTEGER PRIMARY KEY, wallet_id "
+                            "INTEGER, amount INTEGER, transaction_type INTEGER, description TEXT)");
+            m_database.exec("CREATE TABLE IF NOT EXISTS compactions (ledger TEXT PRIMARY KEY, transaction_id INTEGER)");
+            m_database.exec(
+                "CREATE TEMP TABLE checkpoints (wallet_id INTEGER PRIMARY KEY, id INTEGER, amount INTEGER)");
+        }
+        catch (std::exception const& e)
+        {
+            spdlog::get("storage")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    LedgerCompactor::~LedgerCompactor()
+    {
+        this->stop();
+    }
+
+    auto LedgerCompactor::start() -> void
+    {
+        if (m_settings.interval <= std::chrono::seconds::zero() || m_thread.joinable())
+        {
+            return;
+        }
+
+        this->schedule(m_settings.interval);
+        m_thread = std::thread([this]() { m_io_context.run(); });
+    }
+
+    auto LedgerCompactor::stop() -> void
+    {
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+
+        boost::asio::post(m_io_context, [this]() { m_timer.cancel(); });
+        m_work_guard.reset();
+        m_thread.join();
+    }
+
+    auto LedgerCompactor::compact() -> bool
+    {
+        try
+        {
+            // Everything up to the watermark is already checkpoint rows, one per wallet
+            int64_t compacted_id = 0;
+            {
+                SQLite::Statement statement(m_database,
+                                            "SELECT transaction_id FROM compactions WHERE ledger = 'transactions'");
+                if (statement.executeStep())
+                {
+                    compacted_id = statement.getColumn(0).getInt64();
+                }
+            }
+
+            int64_t last_id = 0;
+            {
+                SQLite::Statement statement(m_database, "SELECT MAX(id) FROM transactions");
+                if (statement.executeStep())
+                {
+                    last_id = statement.getColumn(0).getInt64();
+                }
+            }
+
+            int64_t const batch_id =
+                std::min(compacted_id + m_settings.batch_size, last_id - m_settings.retained_transactions);
+            if (batch_id <= compacted_id)
+            {
+                return false;
+            }
+
+            // The history is archived first and in a transaction of its own, a batch archived twice after a crash
+            // in between is ignored by the archive
+            {
+                SQLite::Transaction transaction(m_database);
+                SQLite::Statement statement(m_database, "INSERT OR IGNORE INTO archive.transactions SELECT id, "
+                                                        "wallet_id, amount, transaction_type, description FROM "
+                                                        "main.transactions WHERE id > ? AND id <= ?");
+                statement.bind(1, compacted_id);
+                statement.bind(2, batch_id);
+                statement.exec();
+                transaction.commit();
+            }
+
+            SQLite::Transaction transaction(m_database, SQLite::TransactionBehavior::IMMEDIATE);
+            {
+                // Wallets of the batch net their rows together with their previous checkpoint
+                SQLite::Statement statement(
+                    m_database, "INSERT INTO temp.checkpoints SELECT wallet_id, MAX(id), SUM(CASE transaction_type "
+                                "WHEN 1 THEN amount ELSE -amount END) FROM main.transactions WHERE id <= ? AND "
+                                "wallet_id IN (SELECT wallet_id FROM main.transactions WHERE id > ? AND id <= ?) "
+                                "GROUP BY wallet_id");
+                statement.bind(1, batch_id);
+                statement.bind(2, compacted_id);
+                statement.bind(3, batch_id);
+                statement.exec();
+            }
+
+            int32_t removed = 0;
+            {
+                SQLite::Statement statement(m_database, "DELETE FROM main.transactions WHERE id <= ? AND wallet_id "
+                                                        "IN (SELECT wallet_id FROM temp.checkpoints)");
+                statement.bind(1, batch_id);
+                removed = statement.exec();
+            }
+
+            // A checkpoint takes the id of the last row it replaces, so the ledger keeps its order
+            int32_t const checkpoints =
+                m_database.exec("INSERT INTO main.transactions (id, wallet_id, amount, transaction_type, "
+                                "description) SELECT id, wallet_id, ABS(amount), amount >= 0, 'Checkpoint' "
+                                "FROM temp.checkpoints");
+            m_database.exec("DELETE FROM temp.checkpoints");
+
+            {
+                SQLite::Statement statement(m_database,
+                                            "INSERT INTO compactions (ledger, transaction_id) VALUES "
+                                            "('transactions', ?) ON CONFLICT (ledger) DO UPDATE SET "
+                                            "transaction_id = excluded.transaction_id");
+                statement.bind(1, batch_id);
+                statement.exec();
+            }
+            transaction.commit();
+
+            spdlog::get("storage")->log(spdlog::level::debug,
+                                        "Ledger rows up to id {} were archived, {} rows were rolled into {} "
+                                        "checkpoints",
+                                        batch_id, removed, checkpoints);
+            return true;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("storage")->log(spdlog::level::err, e.what());
+            return false;
+        }
+    }
+
+    auto LedgerCompactor::schedule(std::chrono::milliseconds const delay) -> void
+    {
+        m_timer.expires_after(delay);
+        m_timer.async_wait([this](boost::system::error_code const& error) {
+            if (error)
+            {
+                return;
+            }
+
+            // Batches follow each other until the ledger is compacted, a stop still gets in between them
+            this->schedule(this->compact() ? std::chrono::milliseconds::zero()
+                                           : std::chrono::milliseconds(m_settings.interval));
+        });
+    }
+} // namespace exchange::modules
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "storage.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    struct CompactionSettings
+    {
+        std::filesystem::path archive_path = "archive.db";
+
+        // Zero turns compaction off
+        std::chrono::seconds interval{60};
+
+        // The most recent ledger rows are kept as they are
+        int64_t retained_transactions = 100000;
+
+        // Rows compacted per transaction, so writers never wait long for the lock
+        int64_t batch_size = 10000;
+    };
+
+    // Rolls old ledger rows into one checkpoint row per wallet and moves them to an archive database,
+    // a batch at a time on its own connection and thread. Balances do not change, the checkpoint row
+    // of a wallet nets everything it replaces
+    class LedgerCompactor
+    {
+      public:
+        LedgerCompactor(StorageBackend const& storage, CompactionSettings const& settings,
+                        std::optional<std::filesystem::path> const log_path);
+
+        ~LedgerCompactor();
+
+        auto start() -> void;
+
+        auto stop() -> void;
+
+        // Compacts the next batch, false once nothing is old enough or the batch failed
+        auto compact() -> bool;
+
+      private:
+        SQLite::Database m_database;
+        CompactionSettings m_settings;
+
+        boost::asio::io_context m_io_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work_guard;
+        boost::asio::steady_timer m_timer;
+        std::thread m_thread;
+
+        auto schedule(std::chrono::milliseconds const delay) -> void;
+    };
+} // namespace exchange::modules
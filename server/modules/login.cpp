@@ -1,10 +1,15 @@
 #include "login.hpp"
 #include "precompiled.hpp"
+#include "schema.hpp"
 
 namespace exchange::modules
 {
+    // Sign-in looks users up by name and verifier without reading the table itself
+    constexpr std::array<Migration, 1> users_migrations{
+        {{.version = 1, .statement = "CREATE INDEX IF NOT EXISTS users_user_name ON users (user_name, v)"}}};
+
     LoginSystem::LoginSystem(SQLite::Database& database, std::optional<std::filesystem::path> const log_path)
-        : m_database(&database)
+        : m_database(&database), m_statements(database)
     {
         std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
         if (log_path)
@@ -28,6 +33,16 @@ namespace exchange::modules
                 std::exit(EXIT_FAILURE);
             }
         }
+
+        try
+        {
+            migrate(*m_database, "login", users_migrations);
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("login")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
     }
 
     LoginSystem::~LoginSystem()
@@ -39,9 +54,9 @@ namespace exchange::modules
     {
         try
         {
-            SQLite::Statement statement(*m_database, "SELECT * FROM users WHERE user_name = ?");
-            statement.bind(1, std::string(user_name));
-            return statement.executeStep();
+            auto statement = m_statements.prepare("SELECT * FROM users WHERE user_name = ?");
+            statement->bind(1, std::string(user_name));
+            return statement->executeStep();
         }
         catch (SQLite::Exception e)
         {
@@ -55,12 +70,12 @@ namespace exchange::modules
     {
         try
         {
-            SQLite::Statement statement(*m_database, "SELECT id FROM users WHERE user_name = ? and v = ?");
-            statement.bind(1, std::string(user_name));
-            statement.bind(2, std::string(v));
-            if (statement.executeStep())
+            auto statement = m_statements.prepare("SELECT id FROM users WHERE user_name = ? and v = ?");
+            statement->bind(1, std::string(user_name));
+            statement->bind(2, std::string(v));
+            if (statement->executeStep())
             {
-                m_auth_sessions[session_id].second = statement.getColumn(0).getInt64();
+                m_auth_sessions[session_id].second = statement->getColumn(0).getInt64();
                 return true;
             }
             else
@@ -80,12 +95,12 @@ namespace exchange::modules
     {
         try
         {
-            SQLite::Statement statement(*m_database, "INSERT INTO users (user_name, v) VALUES (?, ?) RETURNING id");
-            statement.bind(1, std::string(user_name));
-            statement.bind(2, std::string(v));
-            if (statement.executeStep())
+            auto statement = m_statements.prepare("INSERT INTO users (user_name, v) VALUES (?, ?) RETURNING id");
+            statement->bind(1, std::string(user_name));
+            statement->bind(2, std::string(v));
+            if (statement->executeStep())
             {
-                user_id = statement.getColumn(0).getInt64();
+                user_id = statement->getColumn(0).getInt64();
             }
             return true;
         }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "statement_cache.hpp"
 #include <SQLiteCpp/SQLiteCpp.h>
 
 namespace exchange::modules
@@ -32,6 +33,7 @@ namespace exchange::modules
 
       private:
         SQLite::Database* m_database;
+        StatementCache m_statements;
         std::unordered_map<uint64_t, std::pair<bool, uint64_t>> m_auth_sessions;
     };
 } // namespace exchange::modules
\ No newline at end of file
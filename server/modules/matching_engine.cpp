@@ -0,0 +1,263 @@
+#include "matching_engine.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    // Engines share one database file, so writers wait for each other instead of failing
+    constexpr int32_t database_busy_timeout = 5000;
+
+    // Restart replays at most this much of the journal on top of the last snapshot
+    constexpr std::chrono::seconds snapshot_interval(60);
+
+    MatchingEngine::MatchingEngine(StorageBackend const& storage, core::InstrumentInfo const& instrument,
+                                   std::optional<std::filesystem::path> const log_path,
+                                   std::optional<std::filesystem::path> const journal_path)
+        : m_instrument(&instrument),
+          m_database(storage.open(database_busy_timeout)),
+          m_wallet(m_database, log_path),
+          m_journal(journal_path ? std::make_unique<Journal>(journal_path.value(), log_path) : nullptr),
+          m_snapshot_path(journal_path ? std::optional(std::filesystem::path(journal_path.value())
+                                                           .replace_extension(".snapshot"))
+                                       : std::nullopt),
+          m_exchange(m_database, log_path, std::span(&instrument, 1), m_journal.get()),
+          m_writer(m_journal ? std::make_unique<EventWriter>(storage, *m_journal, log_path) : nullptr),
+          m_durability(storage.settings().durability), m_commit_scheduled(false),
+          m_work_guard(boost::asio::make_work_guard(m_io_context)), m_auction_timer(m_io_context),
+          m_snapshot_timer(m_io_context)
+    {
+        try
+        {
+            storage.settings().apply(m_database);
+        }
+        catch (std::exception const& e)
+        {
+            spdlog::get("exchange")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+
+        m_exchange.on_execution = [this](Execution const& execution) { m_executions.emplace_back(execution); };
+    }
+
+    MatchingEngine::~MatchingEngine()
+    {
+        this->stop();
+    }
+
+    auto MatchingEngine::start(std::chrono::milliseconds const opening_auction) -> void
+    {
+        // Requests restored from the database may still cross, so they are matched before new ones
+        // unless the session opens with an auction that uncrosses them together with the new ones
+        if (opening_auction > std::chrono::milliseconds::zero())
+        {
+            this->call_auction(opening_auction);
+        }
+
+        if (m_writer)
+        {
+            m_writer->start();
+        }
+
+        boost::asio::post(m_io_context, [this, opening_auction]() {
+            // Journaled events that did not reach the database before the last shutdown come first
+            if (!m_exchange.replay_journal(m_wallet, m_snapshot_path))
+            {
+                spdlog::get("exchange")->log(spdlog::level::critical, "{} journal cannot be replayed",
+                                             m_instrument->name);
+                std::exit(EXIT_FAILURE);
+            }
+
+            if (opening_auction <= std::chrono::milliseconds::zero())
+            {
+                m_exchange.process_requests(m_wallet);
+                this->report_executions();
+                this->schedule_commit();
+            }
+
+            auto const stats = m_exchange.pool_stats();
+            spdlog::get("exchange")->log(spdlog::level::info, "{} order pool: {} of {} orders in use ({} slabs)",
+                                         m_instrument->name, stats.used, stats.capacity, stats.slabs);
+
+            this->schedule_snapshot();
+        });
+
+        m_thread = std::thread([this]() { m_io_context.run(); });
+    }
+
+    auto MatchingEngine::stop() -> void
+    {
+        boost::asio::post(m_io_context, [this]() {
+            m_auction_timer.cancel();
+            m_snapshot_timer.cancel();
+            this->commit();
+
+            // A snapshot of the final state leaves nothing of the journal to replay on the next start
+            if (m_snapshot_path)
+            {
+                m_exchange.save_snapshot(m_snapshot_path.value());
+            }
+
+            auto const stats = m_exchange.statement_stats();
+            spdlog::get("exchange")->log(spdlog::level::info, "{} statement cache: {} hits, {} prepares, {} cached",
+                                         m_instrument->name, stats.hits, stats.prepares, stats.size);
+        });
+        m_work_guard.reset();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+
+        // The last batches are written once nothing is matched anymore
+        if (m_writer)
+        {
+            m_writer->stop();
+        }
+    }
+
+    auto MatchingEngine::submit_order(uint64_t const user_id, int64_t const amount, int64_t const price,
+                                      RequestType const request_type, OrderHandler const& on_complete) -> void
+    {
+        boost::asio::post(m_io_context, [this, user_id, amount, price, request_type, on_complete]() {
+            uint64_t request_id = 0;
+            bool const successful = m_exchange.submit_order(m_wallet, user_id, m_instrument->id, amount, price,
+                                                            request_type, request_id);
+            this->respond([successful, request_id, on_complete]() { on_complete(successful, request_id); });
+            this->report_executions();
+        });
+    }
+
+    auto MatchingEngine::cancel_order(uint64_t const user_id, uint64_t const request_id,
+                                      CancelHandler const& on_complete) -> void
+    {
+        boost::asio::post(m_io_context, [this, user_id, request_id, on_complete]() {
+            bool const successful = m_exchange.cancel_request(user_id, request_id);
+            this->respond([successful, on_complete]() { on_complete(successful); });
+
+            // Cancels queued behind this one are persisted together by the same flush
+            if (successful && !m_journal)
+            {
+                boost::asio::post(m_io_context, [this]() { m_exchange.flush_cancels(); });
+            }
+        });
+    }
+
+    auto MatchingEngine::call_auction(std::chrono::milliseconds const period) -> void
+    {
+        // Orders submitted during the call period rest without matching until the timer uncrosses the book
+        boost::asio::post(m_io_context, [this, period]() {
+            if (!m_exchange.begin_auction(m_instrument->id))
+            {
+                return;
+            }
+
+            m_auction_timer.expires_after(period);
+            m_auction_timer.async_wait([this](boost::system::error_code const& error) {
+                if (error)
+                {
+                    return;
+                }
+
+                if (!m_exchange.uncross(m_wallet, m_instrument->id))
+                {
+                    spdlog::get("exchange")->log(spdlog::level::err, "{} auction failed to uncross",
+                                                 m_instrument->name);
+                }
+                this->report_executions();
+                this->schedule_commit();
+            });
+        });
+    }
+
+    auto MatchingEngine::respond(std::function<void()> const& response) -> void
+    {
+        if (!m_journal)
+        {
+            return response();
+        }
+
+        // Without a durability guarantee the response goes out now and the writer catches up behind it
+        if (m_durability == Durability::Memory)
+        {
+            response();
+        }
+        else
+        {
+            m_pending_responses.emplace_back(response);
+        }
+        this->schedule_commit();
+    }
+
+    auto MatchingEngine::report_executions() -> void
+    {
+        if (m_executions.empty())
+        {
+            return;
+        }
+
+        // Reports wait for the same durability as responses, a fill lost with the journal is never reported
+        if (on_execution)
+        {
+            this->respond([executions = std::move(m_executions), on_execution = on_execution]() {
+                for (auto const& execution : executions)
+                {
+                    on_execution(execution);
+                }
+            });
+        }
+        m_executions.clear();
+    }
+
+    auto MatchingEngine::schedule_commit() -> void
+    {
+        // Work queued behind the scheduled commit joins it, so a burst of requests costs one sync
+        if (m_journal && !m_commit_scheduled)
+        {
+            m_commit_scheduled = true;
+            boost::asio::post(m_io_context, [this]() { this->commit(); });
+        }
+    }
+
+    auto MatchingEngine::commit() -> void
+    {
+        m_commit_scheduled = false;
+        if (!m_writer)
+        {
+            return;
+        }
+
+        // Responses are answered from the writer thread, the matching thread moves on right away
+        auto responses = std::move(m_pending_responses);
+        m_pending_responses.clear();
+        m_writer->write(m_exchange.take_journal_events(), m_journal->sequence(),
+                        [responses = std::move(responses)]() {
+                            for (auto const& response : responses)
+                            {
+                                response();
+                            }
+                        });
+    }
+
+    auto MatchingEngine::schedule_snapshot() -> void
+    {
+        if (!m_snapshot_path)
+        {
+            return;
+        }
+
+        m_snapshot_timer.expires_after(snapshot_interval);
+        m_snapshot_timer.async_wait([this](boost::system::error_code const& error) {
+            if (error)
+            {
+                return;
+            }
+
+            this->commit();
+            m_exchange.save_snapshot(m_snapshot_path.value());
+            this->schedule_snapshot();
+        });
+    }
+
+    auto MatchingEngine::instrument() const -> core::InstrumentInfo const&
+    {
+        return *m_instrument;
+    }
+} // namespace exchange::modules
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core/instrument.hpp"
+#include "event_writer.hpp"
+#include "exchange.hpp"
+#include "journal.hpp"
+#include "storage.hpp"
+#include "wallet.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    // Exchange for a single instrument, owned and driven by a dedicated thread
+    class MatchingEngine
+    {
+      public:
+        using OrderHandler = std::function<void(bool const, uint64_t const)>;
+
+        using CancelHandler = std::function<void(bool const)>;
+
+        using ExecutionHandler = std::function<void(Execution const&)>;
+
+        MatchingEngine(StorageBackend const& storage, core::InstrumentInfo const& instrument,
+                       std::optional<std::filesystem::path> const log_path,
+                       std::optional<std::filesystem::path> const journal_path = std::nullopt);
+
+        ~MatchingEngine();
+
+        auto start(std::chrono::milliseconds const opening_auction = std::chrono::milliseconds::zero()) -> void;
+
+        auto stop() -> void;
+
+        auto submit_order(uint64_t const user_id, int64_t const amount, int64_t const price,
+                          RequestType const request_type, OrderHandler const& on_complete) -> void;
+
+        auto cancel_order(uint64_t const user_id, uint64_t const request_id, CancelHandler const& on_complete)
+            -> void;
+
+        auto call_auction(std::chrono::milliseconds const period) -> void;
+
+        auto instrument() const -> core::InstrumentInfo const&;
+
+        // Set before start, called for fills as durable as the responses. Runs on the matching or the writer thread
+        ExecutionHandler on_execution;
+
+      private:
+        core::InstrumentInfo const* m_instrument;
+
+        SQLite::Database m_database;
+        Wallet m_wallet;
+        std::unique_ptr<Journal> m_journal;
+        std::optional<std::filesystem::path> m_snapshot_path;
+        Exchange m_exchange;
+        std::unique_ptr<EventWriter> m_writer;
+        Durability m_durability;
+
+        // Responses wait for the writer to make their events as durable as the policy asks
+        std::vector<std::function<void()>> m_pending_responses;
+        bool m_commit_scheduled;
+
+        // Fills of the current step, reported behind its response
+        std::vector<Execution> m_executions;
+
+        boost::asio::io_context m_io_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work_guard;
+        boost::asio::steady_timer m_auction_timer;
+        boost::asio::steady_timer m_snapshot_timer;
+        std::thread m_thread;
+
+        auto respond(std::function<void()> const& response) -> void;
+
+        auto report_executions() -> void;
+
+        auto schedule_commit() -> void;
+
+        auto commit() -> void;
+
+        auto schedule_snapshot() -> void;
+    };
+} // namespace exchange::modules
\ No newline at end of file
@@ -0,0 +1,326 @@
+#include "order_book.hpp"
+#include "order_pool.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    OrderBook::OrderBook(OrderPool& pool)
+        : m_pool(&pool), m_bids(&m_resource), m_asks(&m_resource), m_orders(&m_resource)
+    {
+    }
+
+    OrderBook::~OrderBook()
+    {
+        for (auto& [request_id, order] : m_orders)
+        {
+            m_pool->release(order);
+        }
+    }
+
+    auto OrderBook::insert(Order const& order) -> void
+    {
+        if (m_orders.contains(order.request_id))
+        {
+            return;
+        }
+
+        auto element = m_orders.emplace(order.request_id, m_pool->allocate(order)).first;
+
+        if (order.request_type == RequestType::Buy)
+        {
+            this->link(m_bids[order.price], *element->second);
+        }
+        else
+        {
+            this->link(m_asks[order.price], *element->second);
+        }
+    }
+
+    auto OrderBook::erase(uint64_t const request_id) -> bool
+    {
+        auto element = m_orders.find(request_id);
+        if (element == m_orders.end())
+        {
+            return false;
+        }
+
+        auto& order = *element->second;
+        if (order.request_type == RequestType::Buy)
+        {
+            this->erase_from(m_bids, order);
+        }
+        else
+        {
+            this->erase_from(m_asks, order);
+        }
+        return true;
+    }
+
+    auto OrderBook::find(uint64_t const request_id) const -> Order const*
+    {
+        auto element = m_orders.find(request_id);
+        return element != m_orders.end() ? element->second : nullptr;
+    }
+
+    auto OrderBook::reduce(uint64_t const request_id, int64_t const amount) -> bool
+    {
+        auto element = m_orders.find(request_id);
+        if (element == m_orders.end() || element->second->amount < amount)
+        {
+            return false;
+        }
+
+        // The order keeps its time priority unless nothing is left of it
+        element->second->amount -= amount;
+        if (element->second->amount == 0)
+        {
+            return this->erase(request_id);
+        }
+        return true;
+    }
+
+    auto OrderBook::for_each(std::function<void(Order const&)> const& on_order) const -> void
+    {
+        // Levels are visited in time priority, so inserting the orders in the same sequence restores the book
+        for (auto const& [price, level] : m_bids)
+        {
+            for (Order const* order = level.head; order; order = order->next)
+            {
+                on_order(*order);
+            }
+        }
+        for (auto const& [price, level] : m_asks)
+        {
+            for (Order const* order = level.head; order; order = order->next)
+            {
+                on_order(*order);
+            }
+        }
+    }
+
+    auto OrderBook::match(FillHandler const& on_fill) -> bool
+    {
+        return this->sweep(on_fill, std::nullopt);
+    }
+
+    auto OrderBook::auction() const -> std::optional<Auction>
+    {
+        // Bid and ask volume resting at every price of the book
+        std::map<int64_t, std::pair<int64_t, int64_t>> volumes;
+        int64_t demand = 0;
+        for (auto const& [price, level] : m_bids)
+        {
+            for (Order const* order = level.head; order; order = order->next)
+            {
+                volumes[price].first += order->amount;
+                demand += order->amount;
+            }
+        }
+        for (auto const& [price, level] : m_asks)
+        {
+            for (Order const* order = level.head; order; order = order->next)
+            {
+                volumes[price].second += order->amount;
+            }
+        }
+
+        // Prices ascend, so demand only loses the bids below and supply only gains the asks at the price.
+        // Ties on volume go to the smallest imbalance and then to the lowest price
+        std::optional<Auction> auction;
+        int64_t imbalance = 0;
+        int64_t supply = 0;
+        for (auto const& [price, volume] : volumes)
+        {
+            supply += volume.second;
+
+            int64_t const executable = std::min(demand, supply);
+            int64_t const surplus = std::abs(demand - supply);
+            if (executable > 0 && (!auction || executable > auction->volume ||
+                                   (executable == auction->volume && surplus < imbalance)))
+            {
+                auction = Auction{.price = price, .volume = executable};
+                imbalance = surplus;
+            }
+
+            demand -= volume.first;
+        }
+        return auction;
+    }
+
+    auto OrderBook::uncross(int64_t const price, FillHandler const& on_fill) -> bool
+    {
+        return this->sweep(on_fill, price);
+    }
+
+    auto OrderBook::clear() -> void
+    {
+        for (auto& [request_id, order] : m_orders)
+        {
+            m_pool->release(order);
+        }
+        m_orders.clear();
+        m_bids.clear();
+        m_asks.clear();
+    }
+
+    auto OrderBook::sweep(FillHandler const& on_fill, std::optional<int64_t> const clearing_price) -> bool
+    {
+        for (auto bid_level = m_bids.begin(); bid_level != m_bids.end();)
+        {
+            // Bids are visited from the highest price, so nothing below can cross either
+            if (m_asks.empty() || m_asks.begin()->first > bid_level->first ||
+                bid_level->first < clearing_price.value_or(bid_level->first))
+            {
+                break;
+            }
+
+            auto& buyers = bid_level->second;
+            for (Order* buyer = buyers.head; buyer;)
+            {
+                if (!this->match_order(*buyer, m_asks, on_fill, clearing_price))
+                {
+                    return false;
+                }
+
+                Order* next = buyer->next;
+                if (buyer->amount == 0)
+                {
+                    this->unlink(buyers, *buyer);
+                    this->release(*buyer);
+                }
+                buyer = next;
+            }
+
+            bid_level = buyers.head ? std::next(bid_level) : m_bids.erase(bid_level);
+        }
+        return true;
+    }
+
+    auto OrderBook::match(Order& order, FillHandler const& on_fill) -> bool
+    {
+        if (order.request_type == RequestType::Buy)
+        {
+            return this->match_order(order, m_asks, on_fill);
+        }
+        else
+        {
+            return this->match_order(order, m_bids, on_fill);
+        }
+    }
+
+    auto OrderBook::size() const -> size_t
+    {
+        return m_orders.size();
+    }
+
+    auto OrderBook::link(Level& level, Order& order) -> void
+    {
+        order.prev = level.tail;
+        order.next = nullptr;
+        if (level.tail)
+        {
+            level.tail->next = &order;
+        }
+        else
+        {
+            level.head = &order;
+        }
+        level.tail = &order;
+    }
+
+    auto OrderBook::unlink(Level& level, Order& order) -> void
+    {
+        if (order.prev)
+        {
+            order.prev->next = order.next;
+        }
+        else
+        {
+            level.head = order.next;
+        }
+
+        if (order.next)
+        {
+            order.next->prev = order.prev;
+        }
+        else
+        {
+            level.tail = order.prev;
+        }
+        order.prev = order.next = nullptr;
+    }
+
+    auto OrderBook::release(Order& order) -> void
+    {
+        m_orders.erase(order.request_id);
+        m_pool->release(&order);
+    }
+
+    template <typename Levels>
+    auto OrderBook::erase_from(Levels& levels, Order& order) -> void
+    {
+        auto level = levels.find(order.price);
+        this->unlink(level->second, order);
+        if (!level->second.head)
+        {
+            levels.erase(level);
+        }
+        this->release(order);
+    }
+
+    template <typename Levels>
+    auto OrderBook::match_order(Order& order, Levels& levels, FillHandler const& on_fill,
+                                std::optional<int64_t> const clearing_price) -> bool
+    {
+        // A level crosses unless the order price is strictly better than the level price.
+        // An auction executes everything at its clearing price, so that price is the limit instead
+        int64_t const limit = clearing_price.value_or(order.price);
+        for (auto level = levels.begin(); level != levels.end() && !levels.key_comp()(limit, level->first);)
+        {
+            auto& resting_orders = level->second;
+            for (Order* resting = resting_orders.head; resting && order.amount > 0;)
+            {
+                if (resting->user_id == order.user_id)
+                {
+                    resting = resting->next;
+                    continue;
+                }
+
+                bool const is_buyer = order.request_type == RequestType::Buy;
+                Order const& buyer = is_buyer ? order : *resting;
+                Order const& seller = is_buyer ? *resting : order;
+
+                int64_t const amount = std::min(order.amount, resting->amount);
+                if (!on_fill(buyer, seller, amount, clearing_price.value_or(buyer.price)))
+                {
+                    return false;
+                }
+
+                order.amount -= amount;
+                resting->amount -= amount;
+
+                Order* next = resting->next;
+                if (resting->amount == 0)
+                {
+                    this->unlink(resting_orders, *resting);
+                    this->release(*resting);
+                }
+                resting = next;
+            }
+
+            if (!resting_orders.head)
+            {
+                level = levels.erase(level);
+            }
+            else if (order.amount == 0)
+            {
+                break;
+            }
+            else
+            {
+                ++level;
+            }
+        }
+        return true;
+    }
+} // namespace exchange::modules
\ No newline at end of file
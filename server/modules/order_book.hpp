@@ -0,0 +1,99 @@
+#pragma once
+
+namespace exchange::modules
+{
+    enum class RequestType : uint32_t
+    {
+        Buy,
+        Sell
+    };
+
+    struct Order
+    {
+        uint64_t request_id;
+        uint64_t user_id;
+        int64_t amount;
+        int64_t price;
+        RequestType request_type;
+
+        Order* prev = nullptr;
+        Order* next = nullptr;
+    };
+
+    class OrderPool;
+
+    class OrderBook
+    {
+      public:
+        // Orders of one price level in time priority, linked through the orders themselves
+        struct Level
+        {
+            Order* head = nullptr;
+            Order* tail = nullptr;
+        };
+
+        using FillHandler = std::function<bool(Order const& buyer, Order const& seller, int64_t const amount,
+                                               int64_t const price)>;
+
+        // Single price at which a call auction executes the most volume
+        struct Auction
+        {
+            int64_t price;
+            int64_t volume;
+        };
+
+        OrderBook(OrderPool& pool);
+
+        OrderBook(OrderBook const& other) = delete;
+
+        ~OrderBook();
+
+        auto operator=(OrderBook const& other) -> OrderBook& = delete;
+
+        auto insert(Order const& order) -> void;
+
+        auto erase(uint64_t const request_id) -> bool;
+
+        auto find(uint64_t const request_id) const -> Order const*;
+
+        auto reduce(uint64_t const request_id, int64_t const amount) -> bool;
+
+        auto for_each(std::function<void(Order const&)> const& on_order) const -> void;
+
+        auto match(FillHandler const& on_fill) -> bool;
+
+        auto match(Order& order, FillHandler const& on_fill) -> bool;
+
+        auto auction() const -> std::optional<Auction>;
+
+        auto uncross(int64_t const price, FillHandler const& on_fill) -> bool;
+
+        auto clear() -> void;
+
+        auto size() const -> size_t;
+
+      private:
+        OrderPool* m_pool;
+
+        // Index and level nodes are recycled by the resource instead of going back to the heap
+        std::pmr::unsynchronized_pool_resource m_resource;
+        std::pmr::map<int64_t, Level, std::greater<int64_t>> m_bids;
+        std::pmr::map<int64_t, Level, std::less<int64_t>> m_asks;
+        std::pmr::unordered_map<uint64_t, Order*> m_orders;
+
+        auto release(Order& order) -> void;
+
+        auto link(Level& level, Order& order) -> void;
+
+        auto unlink(Level& level, Order& order) -> void;
+
+        template <typename Levels>
+        auto erase_from(Levels& levels, Order& order) -> void;
+
+        auto sweep(FillHandler const& on_fill, std::optional<int64_t> const clearing_price) -> bool;
+
+        template <typename Levels>
+        auto match_order(Order& order, Levels& levels, FillHandler const& on_fill,
+                         std::optional<int64_t> const clearing_price = std::nullopt) -> bool;
+    };
+} // namespace exchange::modules
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "order_pool.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    OrderPool::OrderPool(size_t const slab_size)
+        : m_slab_size(slab_size), m_free_orders(nullptr), m_capacity(0), m_used(0)
+    {
+    }
+
+    auto OrderPool::allocate(Order const& order) -> Order*
+    {
+        if (!m_free_orders)
+        {
+            this->grow(m_slab_size);
+        }
+
+        Order* element = m_free_orders;
+        m_free_orders = element->next;
+
+        *element = order;
+        element->prev = element->next = nullptr;
+        ++m_used;
+        return element;
+    }
+
+    auto OrderPool::release(Order* order) -> void
+    {
+        // Free orders are chained through the same link the order book uses for its levels
+        order->prev = nullptr;
+        order->next = m_free_orders;
+        m_free_orders = order;
+        --m_used;
+    }
+
+    auto OrderPool::reserve(size_t const count) -> void
+    {
+        size_t const available = m_capacity - m_used;
+        if (count > available)
+        {
+            this->grow(count - available);
+        }
+    }
+
+    auto OrderPool::stats() const -> Stats
+    {
+        return Stats{.capacity = m_capacity, .used = m_used, .slabs = m_slabs.size()};
+    }
+
+    auto OrderPool::grow(size_t const count) -> void
+    {
+        auto slab = std::make_unique<Order[]>(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            slab[i].next = i + 1 < count ? &slab[i + 1] : m_free_orders;
+        }
+        m_free_orders = &slab[0];
+
+        m_slabs.emplace_back(std::move(slab));
+        m_capacity += count;
+    }
+} // namespace exchange::modules
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "order_book.hpp"
+
+namespace exchange::modules
+{
+    // Fixed-size slabs of orders, released orders are reused before a new slab is allocated
+    class OrderPool
+    {
+      public:
+        struct Stats
+        {
+            size_t capacity;
+            size_t used;
+            size_t slabs;
+        };
+
+        OrderPool(size_t const slab_size = 4096);
+
+        OrderPool(OrderPool const& other) = delete;
+
+        auto operator=(OrderPool const& other) -> OrderPool& = delete;
+
+        auto allocate(Order const& order) -> Order*;
+
+        auto release(Order* order) -> void;
+
+        auto reserve(size_t const count) -> void;
+
+        auto stats() const -> Stats;
+
+      private:
+        size_t m_slab_size;
+        std::vector<std::unique_ptr<Order[]>> m_slabs;
+
+        Order* m_free_orders;
+        size_t m_capacity;
+        size_t m_used;
+
+        auto grow(size_t const count) -> void;
+    };
+} // namespace exchange::modules
\ No newline at end of file
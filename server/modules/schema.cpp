@@ -0,0 +1,45 @@
+#include "schema.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    auto migrate(SQLite::Database& database, std::string_view const component,
+                 std::span<Migration const> const migrations) -> uint32_t
+    {
+        database.exec("CREATE TABLE IF NOT EXISTS schema_versions (component TEXT PRIMARY KEY, version INTEGER)");
+
+        // Components sharing the database may start at the same time, so the version is read under the write lock
+        SQLite::Transaction transaction(database, SQLite::TransactionBehavior::IMMEDIATE);
+
+        uint32_t version = 0;
+        {
+            SQLite::Statement statement(database, "SELECT version FROM schema_versions WHERE component = ?");
+            statement.bind(1, std::string(component));
+            if (statement.executeStep())
+            {
+                version = statement.getColumn(0).getUInt();
+            }
+        }
+
+        uint32_t const previous_version = version;
+        for (auto const& migration : migrations)
+        {
+            if (migration.version > version)
+            {
+                database.exec(std::string(migration.statement));
+                version = migration.version;
+            }
+        }
+
+        if (version != previous_version)
+        {
+            SQLite::Statement statement(database, "INSERT INTO schema_versions (component, version) VALUES (?, ?) "
+                                                  "ON CONFLICT (component) DO UPDATE SET version = excluded.version");
+            statement.bind(1, std::string(component));
+            statement.bind(2, version);
+            statement.exec();
+        }
+        transaction.commit();
+        return version;
+    }
+} // namespace exchange::modules
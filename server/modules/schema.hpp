@@ -0,0 +1,17 @@
+#pragma once
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    struct Migration
+    {
+        uint32_t version;
+        std::string_view statement;
+    };
+
+    // Runs the migrations of a component newer than the version recorded for it in schema_versions,
+    // in order and in one transaction, and returns the version the schema is at afterwards
+    auto migrate(SQLite::Database& database, std::string_view const component,
+                 std::span<Migration const> const migrations) -> uint32_t;
+} // namespace exchange::modules
@@ -0,0 +1,134 @@
+#include "snapshot.hpp"
+#include "core/binary.hpp"
+#include "precompiled.hpp"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace exchange::modules
+{
+    // The header is the format tag, the journal sequence, the last request id and the number of orders,
+    // and a CRC-32 of everything before it closes the file
+    constexpr std::array<uint8_t, 4> snapshot_tag{'E', 'X', 'S', '1'};
+
+    auto Snapshot::load(std::filesystem::path const& path) -> std::optional<Snapshot>
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return std::nullopt;
+        }
+
+        std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (buffer.size() < snapshot_tag.size() + sizeof(uint32_t) ||
+            !std::equal(snapshot_tag.begin(), snapshot_tag.end(), buffer.begin()))
+        {
+            return std::nullopt;
+        }
+
+        auto const contents = std::span<uint8_t const>(buffer).first(buffer.size() - sizeof(uint32_t));
+        size_t checksum_offset = contents.size();
+        if (core::get_integer<uint32_t>(buffer, checksum_offset) != core::crc32(contents))
+        {
+            return std::nullopt;
+        }
+
+        size_t offset = snapshot_tag.size();
+        auto const sequence = core::get_integer<uint64_t>(contents, offset);
+        auto const last_request_id = core::get_integer<uint64_t>(contents, offset);
+        auto const count = core::get_integer<uint64_t>(contents, offset);
+        if (!sequence || !last_request_id || !count)
+        {
+            return std::nullopt;
+        }
+
+        Snapshot snapshot{.sequence = *sequence, .last_request_id = *last_request_id};
+        snapshot.orders.reserve(*count);
+        for (uint64_t i = 0; i < *count; ++i)
+        {
+            auto const instrument = core::get_integer<core::InstrumentId>(contents, offset);
+            auto const request_id = core::get_integer<uint64_t>(contents, offset);
+            auto const user_id = core::get_integer<uint64_t>(contents, offset);
+            auto const amount = core::get_integer<int64_t>(contents, offset);
+            auto const price = core::get_integer<int64_t>(contents, offset);
+            auto const request_type = core::get_integer<uint8_t>(contents, offset);
+            if (!request_type)
+            {
+                return std::nullopt;
+            }
+
+            snapshot.orders.emplace_back(
+                SnapshotOrder{.instrument = *instrument,
+                              .order = Order{.request_id = *request_id,
+                                             .user_id = *user_id,
+                                             .amount = *amount,
+                                             .price = *price,
+                                             .request_type = static_cast<RequestType>(*request_type)}});
+        }
+        return snapshot;
+    }
+
+    auto Snapshot::save(std::filesystem::path const& path) const -> bool
+    {
+        std::vector<uint8_t> buffer(snapshot_tag.begin(), snapshot_tag.end());
+        core::put_integer<uint64_t>(buffer, sequence);
+        core::put_integer<uint64_t>(buffer, last_request_id);
+        core::put_integer<uint64_t>(buffer, orders.size());
+        for (auto const& [instrument, order] : orders)
+        {
+            core::put_integer<core::InstrumentId>(buffer, instrument);
+            core::put_integer<uint64_t>(buffer, order.request_id);
+            core::put_integer<uint64_t>(buffer, order.user_id);
+            core::put_integer<int64_t>(buffer, order.amount);
+            core::put_integer<int64_t>(buffer, order.price);
+            core::put_integer<uint8_t>(buffer, static_cast<uint8_t>(order.request_type));
+        }
+        core::put_integer<uint32_t>(buffer, core::crc32(buffer));
+
+        // The previous snapshot stays in place until the new one is complete
+        std::filesystem::path temporary_path = path;
+        temporary_path += ".tmp";
+        std::FILE* file = std::fopen(temporary_path.string().c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+
+        // The contents are synced before the rename, or a crash could leave the new name on an empty file
+        bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && std::fflush(file) == 0;
+#ifdef _WIN32
+        written = written && _commit(_fileno(file)) == 0;
+#else
+        written = written && fdatasync(fileno(file)) == 0;
+#endif
+        if (std::fclose(file) != 0 || !written)
+        {
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        // The rename itself is only durable once the directory holding both names is synced
+#ifndef _WIN32
+        std::filesystem::path const directory = path.has_parent_path() ? path.parent_path() : ".";
+        int const directory_fd = open(directory.string().c_str(), O_RDONLY | O_DIRECTORY);
+        if (directory_fd < 0)
+        {
+            return false;
+        }
+        bool const synced = fsync(directory_fd) == 0;
+        close(directory_fd);
+        return synced;
+#else
+        return true;
+#endif
+    }
+} // namespace exchange::modules
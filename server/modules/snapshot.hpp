@@ -0,0 +1,25 @@
+#pragma once
+
+#include "core/instrument.hpp"
+#include "order_book.hpp"
+
+namespace exchange::modules
+{
+    struct SnapshotOrder
+    {
+        core::InstrumentId instrument;
+        Order order;
+    };
+
+    // Open requests as of a journal sequence, kept in time priority within every price level
+    struct Snapshot
+    {
+        uint64_t sequence;
+        uint64_t last_request_id;
+        std::vector<SnapshotOrder> orders;
+
+        static auto load(std::filesystem::path const& path) -> std::optional<Snapshot>;
+
+        auto save(std::filesystem::path const& path) const -> bool;
+    };
+} // namespace exchange::modules
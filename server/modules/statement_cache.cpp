@@ -0,0 +1,67 @@
+#include "statement_cache.hpp"
+#include "precompiled.hpp"
+
+namespace exchange::modules
+{
+    StatementCache::Statement::Statement(SQLite::Statement& statement, bool& in_use)
+        : m_statement(&statement), m_in_use(&in_use)
+    {
+        in_use = true;
+    }
+
+    StatementCache::Statement::Statement(std::unique_ptr<SQLite::Statement> statement)
+        : m_owned(std::move(statement)), m_statement(m_owned.get()), m_in_use(nullptr)
+    {
+    }
+
+    StatementCache::Statement::~Statement()
+    {
+        if (m_in_use)
+        {
+            m_statement->tryReset();
+            m_statement->clearBindings();
+            *m_in_use = false;
+        }
+    }
+
+    auto StatementCache::Statement::operator*() -> SQLite::Statement&
+    {
+        return *m_statement;
+    }
+
+    auto StatementCache::Statement::operator->() -> SQLite::Statement*
+    {
+        return m_statement;
+    }
+
+    StatementCache::StatementCache(SQLite::Database& database) : m_database(&database), m_hits(0), m_prepares(0)
+    {
+    }
+
+    auto StatementCache::prepare(std::string_view const query) -> Statement
+    {
+        auto element = m_statements.find(query);
+        if (element == m_statements.end())
+        {
+            ++m_prepares;
+            auto statement = std::make_unique<SQLite::Statement>(*m_database, std::string(query));
+            element = m_statements.emplace(std::string(query), Entry{.statement = std::move(statement)}).first;
+            return Statement(*element->second.statement, element->second.in_use);
+        }
+
+        // A query nested inside a running one of its own gets a statement of its own
+        if (element->second.in_use)
+        {
+            ++m_prepares;
+            return Statement(std::make_unique<SQLite::Statement>(*m_database, std::string(query)));
+        }
+
+        ++m_hits;
+        return Statement(*element->second.statement, element->second.in_use);
+    }
+
+    auto StatementCache::stats() const -> Stats
+    {
+        return Stats{.hits = m_hits, .prepares = m_prepares, .size = m_statements.size()};
+    }
+} // namespace exchange::modules
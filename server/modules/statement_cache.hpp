@@ -0,0 +1,75 @@
+#pragma once
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    // Prepared statements of one connection, compiled on first use and kept for the lifetime of the cache
+    class StatementCache
+    {
+      public:
+        struct Stats
+        {
+            size_t hits;
+            size_t prepares;
+            size_t size;
+        };
+
+        // Lends a statement and hands it back reset and unbound, so it holds no locks while cached
+        class Statement
+        {
+          public:
+            Statement(SQLite::Statement& statement, bool& in_use);
+
+            Statement(std::unique_ptr<SQLite::Statement> statement);
+
+            Statement(Statement const& other) = delete;
+
+            ~Statement();
+
+            auto operator=(Statement const& other) -> Statement& = delete;
+
+            auto operator*() -> SQLite::Statement&;
+
+            auto operator->() -> SQLite::Statement*;
+
+          private:
+            std::unique_ptr<SQLite::Statement> m_owned;
+            SQLite::Statement* m_statement;
+            bool* m_in_use;
+        };
+
+        StatementCache(SQLite::Database& database);
+
+        StatementCache(StatementCache const& other) = delete;
+
+        auto operator=(StatementCache const& other) -> StatementCache& = delete;
+
+        auto prepare(std::string_view const query) -> Statement;
+
+        auto stats() const -> Stats;
+
+      private:
+        struct Entry
+        {
+            std::unique_ptr<SQLite::Statement> statement;
+            bool in_use = false;
+        };
+
+        // Queries are looked up by view, without building a string on every call
+        struct QueryHash
+        {
+            using is_transparent = void;
+
+            auto operator()(std::string_view const query) const -> size_t
+            {
+                return std::hash<std::string_view>{}(query);
+            }
+        };
+
+        SQLite::Database* m_database;
+        std::unordered_map<std::string, Entry, QueryHash, std::equal_to<>> m_statements;
+        size_t m_hits;
+        size_t m_prepares;
+    };
+} // namespace exchange::modules
@@ -0,0 +1,331 @@
+#include "storage.hpp"
+#include "precompiled.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace exchange::modules
+{
+    constexpr std::array<std::string_view, 6> journal_modes{"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"};
+
+    constexpr std::array<std::string_view, 4> synchronous_levels{"OFF", "NORMAL", "FULL", "EXTRA"};
+
+    // The checkpointer shares the file with the engines, so it waits for their writes instead of failing
+    constexpr int32_t checkpoint_busy_timeout = 5000;
+
+    namespace
+    {
+        // Position of the name in names regardless of case, names.size() if it is not there
+        template <size_t size>
+        auto find_name(std::array<std::string_view, size> const& names, std::string_view const value) -> size_t
+        {
+            return std::find_if(names.begin(), names.end(),
+                                [value](std::string_view const name) {
+                                    return std::equal(name.begin(), name.end(), value.begin(), value.end(),
+                                                      [](char const a, char const b) {
+                                                          return a == std::toupper(static_cast<unsigned char>(b));
+                                                      });
+                                }) -
+                   names.begin();
+        }
+    } // namespace
+
+    auto StorageSettings::apply(SQLite::Database& database) const -> void
+    {
+        // Modes are spliced into the pragmas, so only the names SQLite knows get through
+        if (find_name(journal_modes, journal_mode) == journal_modes.size())
+        {
+            throw std::invalid_argument(fmt::format("Unknown journal mode '{}'", journal_mode));
+        }
+        if (find_name(synchronous_levels, synchronous) == synchronous_levels.size())
+        {
+            throw std::invalid_argument(fmt::format("Unknown synchronous level '{}'", synchronous));
+        }
+
+        database.exec(fmt::format("PRAGMA journal_mode = {}", journal_mode));
+        database.exec(fmt::format("PRAGMA synchronous = {}", synchronous));
+        database.exec(fmt::format("PRAGMA mmap_size = {}", mmap_size));
+        database.exec(fmt::format("PRAGMA cache_size = {}", cache_size));
+
+        // With a checkpointer running, no commit on the request path copies the WAL back
+        if (checkpoint_interval > std::chrono::milliseconds::zero())
+        {
+            database.exec("PRAGMA wal_autocheckpoint = 0");
+        }
+    }
+
+    auto StorageSettings::apply_unjournaled(SQLite::Database& database) const -> void
+    {
+        this->apply(database);
+
+        // Levels are listed from the weakest, so EXTRA is left as it is
+        if (find_name(synchronous_levels, synchronous) < find_name(synchronous_levels, "FULL"))
+        {
+            database.exec("PRAGMA synchronous = FULL");
+        }
+    }
+
+    auto StorageSettings::describe(SQLite::Database& database) -> std::string
+    {
+        auto const pragma = [&database](std::string_view const name) {
+            SQLite::Statement statement(database, fmt::format("PRAGMA {}", name));
+            return statement.executeStep() ? statement.getColumn(0).getString() : std::string();
+        };
+        return fmt::format("journal_mode {}, synchronous {}, mmap_size {}, cache_size {}, wal_autocheckpoint {}",
+                           pragma("journal_mode"), pragma("synchronous"), pragma("mmap_size"), pragma("cache_size"),
+                           pragma("wal_autocheckpoint"));
+    }
+
+    StorageBackend::StorageBackend(StorageSettings const& settings,
+                                   std::optional<std::filesystem::path> const log_path)
+        : m_settings(settings)
+    {
+        // The logger is left to the checkpointer to drop, a backend may be gone before the connections it opened
+        if (!spdlog::get("storage"))
+        {
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("storage", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
+        }
+    }
+
+    auto StorageBackend::flush() -> bool
+    {
+        return true;
+    }
+
+    auto StorageBackend::settings() const -> StorageSettings const&
+    {
+        return m_settings;
+    }
+
+    auto StorageBackend::create(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path)
+        -> std::unique_ptr<StorageBackend>
+    {
+        switch (settings.backend)
+        {
+            case BackendType::Memory:
+                return std::make_unique<MemoryBackend>(settings, log_path);
+            case BackendType::Journal:
+                return std::make_unique<JournalBackend>(settings, log_path);
+            default:
+                return std::make_unique<SQLiteBackend>(settings, log_path);
+        }
+    }
+
+    SQLiteBackend::SQLiteBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path)
+        : StorageBackend(settings, log_path)
+    {
+    }
+
+    auto SQLiteBackend::open(int32_t const busy_timeout) const -> SQLite::Database
+    {
+        return SQLite::Database(m_settings.path.string(), SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE, busy_timeout);
+    }
+
+    auto SQLiteBackend::persistent() const -> bool
+    {
+        return true;
+    }
+
+    auto SQLiteBackend::journaled() const -> bool
+    {
+        return true;
+    }
+
+    auto SQLiteBackend::name() const -> std::string_view
+    {
+        return "sqlite";
+    }
+
+    // Each backend gets a database of its own, even with several of them in one process
+    std::atomic<uint64_t> memory_databases = 0;
+
+    MemoryBackend::MemoryBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path)
+        : StorageBackend(settings, log_path),
+          // The memdb VFS shares one database between connections and locks like a file, so busy timeouts still work
+          m_uri(fmt::format("file:/exchange_{}?vfs=memdb", memory_databases++)), m_database(this->open())
+    {
+    }
+
+    auto MemoryBackend::open(int32_t const busy_timeout) const -> SQLite::Database
+    {
+        return SQLite::Database(m_uri, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE | SQLite::OPEN_URI, busy_timeout);
+    }
+
+    auto MemoryBackend::persistent() const -> bool
+    {
+        return false;
+    }
+
+    auto MemoryBackend::journaled() const -> bool
+    {
+        return false;
+    }
+
+    auto MemoryBackend::name() const -> std::string_view
+    {
+        return "memory";
+    }
+
+    JournalBackend::JournalBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path)
+        : MemoryBackend(settings, log_path)
+    {
+        if (!std::filesystem::exists(m_settings.path))
+        {
+            return;
+        }
+
+        try
+        {
+            m_database.backup(m_settings.path.string().c_str(), SQLite::Database::Load);
+            spdlog::get("storage")->log(spdlog::level::info, "Tables restored from {}", m_settings.path.string());
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("storage")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    auto JournalBackend::journaled() const -> bool
+    {
+        return true;
+    }
+
+    auto JournalBackend::name() const -> std::string_view
+    {
+        return "journal";
+    }
+
+    auto JournalBackend::flush() -> bool
+    {
+        // The image is written next to the old one and swapped in, so a crash while writing keeps the old one
+        auto image_path = m_settings.path;
+        image_path += ".tmp";
+        try
+        {
+            std::filesystem::remove(image_path);
+            m_database.backup(image_path.string().c_str(), SQLite::Database::Save);
+            std::filesystem::rename(image_path, m_settings.path);
+        }
+        catch (std::exception const& e)
+        {
+            spdlog::get("storage")->log(spdlog::level::err, e.what());
+            return false;
+        }
+
+        // Until its directory is synced, a power loss may bring back the old image and lose the new accounts
+#ifndef _WIN32
+        std::filesystem::path const directory =
+            m_settings.path.has_parent_path() ? m_settings.path.parent_path() : std::filesystem::path(".");
+        int const directory_fd = ::open(directory.string().c_str(), O_RDONLY | O_DIRECTORY);
+        if (directory_fd < 0)
+        {
+            spdlog::get("storage")->log(spdlog::level::err, "{} cannot be opened to sync it", directory.string());
+            return false;
+        }
+        bool const synced = fsync(directory_fd) == 0;
+        ::close(directory_fd);
+        if (!synced)
+        {
+            spdlog::get("storage")->log(spdlog::level::err, "{} sync failed", directory.string());
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    Checkpointer::Checkpointer(StorageBackend const& storage, std::optional<std::filesystem::path> const log_path)
+        : m_database(storage.open(checkpoint_busy_timeout)),
+          // Memory has no WAL to copy back
+          m_interval(storage.persistent() ? storage.settings().checkpoint_interval : std::chrono::milliseconds::zero()),
+          m_work_guard(boost::asio::make_work_guard(m_io_context)), m_timer(m_io_context)
+    {
+        if (!spdlog::get("storage"))
+        {
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("storage", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
+        }
+    }
+
+    Checkpointer::~Checkpointer()
+    {
+        this->stop();
+    }
+
+    auto Checkpointer::start() -> void
+    {
+        if (m_interval <= std::chrono::milliseconds::zero() || m_thread.joinable())
+        {
+            return;
+        }
+
+        this->schedule();
+        m_thread = std::thread([this]() { m_io_context.run(); });
+    }
+
+    auto Checkpointer::stop() -> void
+    {
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+
+        // The engines have stopped writing, so the last checkpoint leaves the WAL empty
+        boost::asio::post(m_io_context, [this]() {
+            m_timer.cancel();
+            this->checkpoint(true);
+        });
+        m_work_guard.reset();
+        m_thread.join();
+    }
+
+    auto Checkpointer::checkpoint(bool const truncate) -> bool
+    {
+        try
+        {
+            SQLite::Statement statement(m_database, truncate ? "PRAGMA wal_checkpoint(TRUNCATE)"
+                                                             : "PRAGMA wal_checkpoint(PASSIVE)");
+            if (!statement.executeStep())
+            {
+                return false;
+            }
+
+            bool const busy = statement.getColumn(0).getInt() != 0;
+            spdlog::get("storage")->log(spdlog::level::trace, "Checkpoint: {} of {} WAL pages copied{}",
+                                        statement.getColumn(2).getInt(), statement.getColumn(1).getInt(),
+                                        busy ? ", blocked by a reader" : "");
+            return !busy;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("storage")->log(spdlog::level::err, e.what());
+            return false;
+        }
+    }
+
+    auto Checkpointer::schedule() -> void
+    {
+        m_timer.expires_after(m_interval);
+        m_timer.async_wait([this](boost::system::error_code const& error) {
+            if (error)
+            {
+                return;
+            }
+
+            this->checkpoint();
+            this->schedule();
+        });
+    }
+} // namespace exchange::modules
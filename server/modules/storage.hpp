@@ -0,0 +1,166 @@
+#pragma once
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+namespace exchange::modules
+{
+    // When a journaled request is acknowledged: right after matching, once the journal is synced,
+    // or once its events are in the database too
+    enum class Durability : uint8_t
+    {
+        Memory,
+        Journal,
+        Database
+    };
+
+    // What keeps the tables: the database file, memory only, or memory restored from an image of the file
+    // and the order journals
+    enum class BackendType : uint8_t
+    {
+        SQLite,
+        Memory,
+        Journal
+    };
+
+    // How the database file is opened, applied by every connection that shares it
+    struct StorageSettings
+    {
+        BackendType backend = BackendType::SQLite;
+
+        // The database file, or the image a journal backend is restored from
+        std::filesystem::path path = "database.db";
+        std::string journal_mode = "WAL";
+
+        // NORMAL may lose the last transactions on power loss in WAL mode. The order journal replays those of
+        // the engines, connections writing anything else apply it with apply_unjournaled
+        std::string synchronous = "NORMAL";
+
+        int64_t mmap_size = 256 * 1024 * 1024;
+
+        // Pages when positive, KiB when negative
+        int64_t cache_size = -64 * 1024;
+
+        // Zero leaves checkpoints to whichever connection commits past the WAL limit
+        std::chrono::milliseconds checkpoint_interval{1000};
+
+        Durability durability = Durability::Journal;
+
+        auto apply(SQLite::Database& database) const -> void;
+
+        // As apply, for a connection whose commits no journal replays, such as accounts and wallets. Its commits
+        // are synced at least as with FULL
+        auto apply_unjournaled(SQLite::Database& database) const -> void;
+
+        // Settings in effect on a connection, as SQLite reports them back
+        static auto describe(SQLite::Database& database) -> std::string;
+    };
+
+    // Modules keep their tables in SQL, a backend decides what is behind the connections they open
+    class StorageBackend
+    {
+      public:
+        StorageBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path);
+
+        virtual ~StorageBackend() = default;
+
+        // Every connection of a backend sees the same tables, the settings are applied by whoever opens one
+        virtual auto open(int32_t const busy_timeout = 0) const -> SQLite::Database = 0;
+
+        // Whether the tables are in a file of their own, which then needs WAL checkpoints
+        virtual auto persistent() const -> bool = 0;
+
+        // Whether engines journal their events, which is pointless when nothing outlives the process
+        virtual auto journaled() const -> bool = 0;
+
+        virtual auto name() const -> std::string_view = 0;
+
+        // Writes out what only lives in memory. Writers on other connections wait until it is done
+        virtual auto flush() -> bool;
+
+        auto settings() const -> StorageSettings const&;
+
+        static auto create(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path)
+            -> std::unique_ptr<StorageBackend>;
+
+      protected:
+        StorageSettings m_settings;
+    };
+
+    class SQLiteBackend : public StorageBackend
+    {
+      public:
+        SQLiteBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path);
+
+        auto open(int32_t const busy_timeout = 0) const -> SQLite::Database override;
+
+        auto persistent() const -> bool override;
+
+        auto journaled() const -> bool override;
+
+        auto name() const -> std::string_view override;
+    };
+
+    // Tables live in memory shared by the connections of the backend, and are gone with it
+    class MemoryBackend : public StorageBackend
+    {
+      public:
+        MemoryBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path);
+
+        auto open(int32_t const busy_timeout = 0) const -> SQLite::Database override;
+
+        auto persistent() const -> bool override;
+
+        auto journaled() const -> bool override;
+
+        auto name() const -> std::string_view override;
+
+      protected:
+        std::string m_uri;
+
+        // Memory databases are dropped with their last connection
+        SQLite::Database m_database;
+    };
+
+    // Tables live in memory, restored from an image of the database file on start and written back to it on
+    // flush. Order events since the image are replayed from the journals, so the image only has to be written
+    // again when accounts or wallets are created.
+    // Each flush copies and syncs the whole database, which takes time in proportion to its size. Registrations
+    // pay this cost in exchange for an image that is complete once they are answered
+    class JournalBackend : public MemoryBackend
+    {
+      public:
+        JournalBackend(StorageSettings const& settings, std::optional<std::filesystem::path> const log_path);
+
+        auto journaled() const -> bool override;
+
+        auto name() const -> std::string_view override;
+
+        auto flush() -> bool override;
+    };
+
+    // Copies the WAL back into the database file on its own connection and thread
+    class Checkpointer
+    {
+      public:
+        Checkpointer(StorageBackend const& storage, std::optional<std::filesystem::path> const log_path);
+
+        ~Checkpointer();
+
+        auto start() -> void;
+
+        auto stop() -> void;
+
+        auto checkpoint(bool const truncate = false) -> bool;
+
+      private:
+        SQLite::Database m_database;
+        std::chrono::milliseconds m_interval;
+
+        boost::asio::io_context m_io_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work_guard;
+        boost::asio::steady_timer m_timer;
+        std::thread m_thread;
+
+        auto schedule() -> void;
+    };
+} // namespace exchange::modules
@@ -1,18 +1,31 @@
 #include "wallet.hpp"
+#include "core/instrument.hpp"
 #include "precompiled.hpp"
+#include "schema.hpp"
 
 namespace exchange::modules
 {
+    // Wallets are listed and the ledger of a wallet audited without reading the tables themselves
+    constexpr std::array<Migration, 2> wallet_migrations{
+        {{.version = 1, .statement = "CREATE INDEX IF NOT EXISTS wallets_user ON wallets (user_id, currency)"},
+         {.version = 2,
+          .statement = "CREATE INDEX IF NOT EXISTS transactions_wallet ON transactions "
+                       "(wallet_id, transaction_type, amount)"}}};
+
     Wallet::Wallet(SQLite::Database& database, std::optional<std::filesystem::path> const log_path)
-        : m_database(&database)
+        : m_database(&database), m_statements(database)
     {
-        std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
-        if (log_path)
+        // Core and every matching engine hold their own instance, and they all share one logger
+        if (!spdlog::get("wallet"))
         {
-            sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            std::vector<spdlog::sink_ptr> sinks{std::make_shared<spdlog::sinks::stdout_color_sink_mt>()};
+            if (log_path)
+            {
+                sinks.emplace_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(log_path.value().string()));
+            }
+            auto logger = std::make_shared<spdlog::logger>("wallet", sinks.begin(), sinks.end());
+            spdlog::initialize_logger(logger);
         }
-        auto logger = std::make_shared<spdlog::logger>("wallet", sinks.begin(), sinks.end());
-        spdlog::initialize_logger(logger);
 
         if (!database.tableExists("wallets"))
         {
@@ -29,13 +42,14 @@ namespace exchange::modules
             }
         }
 
-        if (!database.tableExists("transactions"))
+        bool const ledger_created = !database.tableExists("transactions");
+        if (ledger_created)
         {
             try
             {
                 SQLite::Statement statement(*m_database,
                                             "CREATE TABLE transactions (id INTEGER PRIMARY KEY, wallet_id "
-                                            "INTEGER, amount REAL, transaction_type INTEGER, description TEXT)");
+                                            "INTEGER, amount INTEGER, transaction_type INTEGER, description TEXT)");
                 statement.exec();
             }
             catch (SQLite::Exception e)
@@ -44,24 +58,45 @@ namespace exchange::modules
                 std::exit(EXIT_FAILURE);
             }
         }
-    }
+        else
+        {
+            this->upgrade_transactions();
+        }
 
-    Wallet::~Wallet()
-    {
-        spdlog::drop("wallet");
+        // Balances are derived from the ledger, so a new ledger or a database that predates them rebuilds them
+        if (ledger_created || !database.tableExists("balances"))
+        {
+            this->rebuild_balances();
+        }
+
+        try
+        {
+            migrate(*m_database, "wallet", wallet_migrations);
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("wallet")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
     }
 
     auto Wallet::create_wallet(uint64_t const user_id, std::string_view const currency, uint64_t& wallet_id) -> bool
     {
         try
         {
-            SQLite::Statement statement(*m_database,
-                                        "INSERT INTO wallets (user_id, currency) VALUES (?, ?) RETURNING id");
-            statement.bind(1, static_cast<int64_t>(user_id));
-            statement.bind(2, std::string(currency));
-            if (statement.executeStep())
+            auto statement = m_statements.prepare("INSERT INTO wallets (user_id, currency) VALUES (?, ?) RETURNING id");
+            statement->bind(1, static_cast<int64_t>(user_id));
+            statement->bind(2, std::string(currency));
+            if (statement->executeStep())
             {
-                wallet_id = statement.getColumn(0).getInt64();
+                wallet_id = statement->getColumn(0).getInt64();
+
+                auto wallet_ids = m_wallet_ids.find(user_id);
+                auto const currency_info = core::find_currency(currency);
+                if (wallet_ids != m_wallet_ids.end() && currency_info)
+                {
+                    wallet_ids->second[currency_info->id] = wallet_id;
+                }
             }
             return true;
         }
@@ -72,19 +107,43 @@ namespace exchange::modules
         }
     }
 
-    auto Wallet::make_transaction(uint64_t const wallet_id, float const amount,
+    auto Wallet::make_transaction(uint64_t const wallet_id, int64_t const amount,
                                   WalletTransactionType const transaction_type,
                                   std::string_view const description) -> bool
     {
         try
         {
-            SQLite::Statement statement(*m_database, "INSERT INTO transactions (wallet_id, amount, "
-                                                     "transaction_type, description) VALUES (?, ?, ?, ?)");
-            statement.bind(1, static_cast<int64_t>(wallet_id));
-            statement.bind(2, amount);
-            statement.bind(3, static_cast<uint32_t>(transaction_type));
-            statement.bind(4, std::string(description));
-            return statement.exec() > 0;
+            // A savepoint nests inside the caller's transaction, so the ledger row and the balance commit together
+            m_statements.prepare("SAVEPOINT make_transaction")->exec();
+            try
+            {
+                {
+                    auto statement = m_statements.prepare("INSERT INTO transactions (wallet_id, amount, "
+                                                          "transaction_type, description) VALUES (?, ?, ?, ?)");
+                    statement->bind(1, static_cast<int64_t>(wallet_id));
+                    statement->bind(2, amount);
+                    statement->bind(3, static_cast<uint32_t>(transaction_type));
+                    statement->bind(4, std::string(description));
+                    statement->exec();
+                }
+
+                {
+                    auto statement = m_statements.prepare(
+                        "INSERT INTO balances (wallet_id, amount) VALUES (?, ?) "
+                        "ON CONFLICT (wallet_id) DO UPDATE SET amount = amount + excluded.amount");
+                    statement->bind(1, static_cast<int64_t>(wallet_id));
+                    statement->bind(2, transaction_type == WalletTransactionType::Deposit ? amount : -amount);
+                    statement->exec();
+                }
+            }
+            catch (...)
+            {
+                m_statements.prepare("ROLLBACK TO make_transaction")->exec();
+                m_statements.prepare("RELEASE make_transaction")->exec();
+                throw;
+            }
+            m_statements.prepare("RELEASE make_transaction")->exec();
+            return true;
         }
         catch (SQLite::Exception e)
         {
@@ -98,54 +157,124 @@ namespace exchange::modules
         try
         {
             std::vector<WalletInfo> wallet_infos;
+            auto statement = m_statements.prepare("SELECT wallets.id, wallets.currency, COALESCE(balances.amount, 0) "
+                                                  "FROM wallets LEFT JOIN balances ON balances.wallet_id = wallets.id "
+                                                  "WHERE wallets.user_id = ?");
+            statement->bind(1, static_cast<int64_t>(user_id));
+
+            while (statement->executeStep())
             {
-                SQLite::Statement statement(*m_database, "SELECT id, currency FROM wallets WHERE user_id = ?");
-                statement.bind(1, static_cast<int64_t>(user_id));
+                WalletInfo wallet_info{.id = static_cast<uint64_t>(statement->getColumn(0).getInt64()),
+                                       .currency = statement->getColumn(1).getString(),
+                                       .amount = statement->getColumn(2).getInt64()};
+                wallet_infos.emplace_back(std::move(wallet_info));
+            }
+            return wallet_infos;
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("wallet")->log(spdlog::level::err, e.what());
+            return std::nullopt;
+        }
+    }
 
-                while (statement.executeStep())
+    auto Wallet::find_wallet(uint64_t const user_id, core::CurrencyId const currency, uint64_t& wallet_id) -> bool
+    {
+        auto& wallet_ids = m_wallet_ids[user_id];
+        if (wallet_ids[currency] != 0)
+        {
+            wallet_id = wallet_ids[currency];
+            return true;
+        }
+
+        // Wallets may have been created through another connection since the user was cached
+        try
+        {
+            auto statement = m_statements.prepare("SELECT id, currency FROM wallets WHERE user_id = ?");
+            statement->bind(1, static_cast<int64_t>(user_id));
+
+            while (statement->executeStep())
+            {
+                auto const currency_info = core::find_currency(statement->getColumn(1).getString());
+                if (currency_info && wallet_ids[currency_info->id] == 0)
                 {
-                    WalletInfo wallet_info{.id = static_cast<uint64_t>(statement.getColumn(0).getInt64()),
-                                           .currency = statement.getColumn(1).getString()};
-                    wallet_infos.emplace_back(std::move(wallet_info));
+                    wallet_ids[currency_info->id] = statement->getColumn(0).getInt64();
                 }
             }
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("wallet")->log(spdlog::level::err, e.what());
+            return false;
+        }
 
-            for (auto& wallet_info : wallet_infos)
-            {
-                float amount = 0.0f;
+        wallet_id = wallet_ids[currency];
+        return wallet_id != 0;
+    }
 
-                {
-                    SQLite::Statement statement(
-                        *m_database,
-                        "SELECT SUM(amount) FROM transactions WHERE wallet_id = ? and transaction_type = 1");
-                    statement.bind(1, static_cast<int64_t>(wallet_info.id));
-
-                    if (statement.executeStep())
-                    {
-                        amount = statement.getColumn(0).getDouble();
-                    }
-                }
+    auto Wallet::statement_stats() const -> StatementCache::Stats
+    {
+        return m_statements.stats();
+    }
+
+    auto Wallet::rebuild_balances() -> void
+    {
+        try
+        {
+            SQLite::Transaction transaction(*m_database);
+            m_database->exec("DROP TABLE IF EXISTS balances");
+            m_database->exec("CREATE TABLE balances (wallet_id INTEGER PRIMARY KEY, amount INTEGER)");
+            m_database->exec("INSERT INTO balances SELECT wallet_id, SUM(CASE transaction_type WHEN 1 THEN amount "
+                             "ELSE -amount END) FROM transactions GROUP BY wallet_id");
+            transaction.commit();
+        }
+        catch (SQLite::Exception e)
+        {
+            spdlog::get("wallet")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
 
+    auto Wallet::upgrade_transactions() -> void
+    {
+        try
+        {
+            {
+                SQLite::Statement statement(
+                    *m_database, "SELECT type FROM pragma_table_info('transactions') WHERE name = 'amount'");
+                if (!statement.executeStep() || statement.getColumn(0).getString() != "REAL")
                 {
-                    SQLite::Statement statement(
-                        *m_database,
-                        "SELECT SUM(amount) FROM transactions WHERE wallet_id = ? and transaction_type = 0");
-                    statement.bind(1, static_cast<int64_t>(wallet_info.id));
-
-                    if (statement.executeStep())
-                    {
-                        amount -= statement.getColumn(0).getDouble();
-                    }
+                    return;
                 }
+            }
+
+            // Transactions were stored as REAL before amounts became fixed-point
+            SQLite::Transaction transaction(*m_database);
+            m_database->exec("ALTER TABLE transactions RENAME TO transactions_legacy");
+            m_database->exec("CREATE TABLE transactions (id INTEGER PRIMARY KEY, wallet_id INTEGER, "
+                             "amount INTEGER, transaction_type INTEGER, description TEXT)");
 
-                wallet_info.amount = amount;
+            for (auto const& currency : core::currencies)
+            {
+                SQLite::Statement statement(
+                    *m_database, "INSERT INTO transactions SELECT transactions_legacy.id, wallet_id, "
+                                 "CAST(ROUND(amount * ?) AS INTEGER), transaction_type, description "
+                                 "FROM transactions_legacy INNER JOIN wallets ON wallet_id = wallets.id "
+                                 "WHERE wallets.currency = ?");
+                statement.bind(1, core::pow10(currency.scale));
+                statement.bind(2, std::string(currency.name));
+                statement.exec();
             }
-            return wallet_infos;
+
+            m_database->exec("DROP TABLE transactions_legacy");
+            transaction.commit();
+
+            spdlog::get("wallet")->log(spdlog::level::info, "Transactions were converted to fixed-point amounts");
         }
         catch (SQLite::Exception e)
         {
-            spdlog::get("wallet")->log(spdlog::level::err, e.what());
-            return std::nullopt;
+            spdlog::get("wallet")->log(spdlog::level::critical, e.what());
+            std::exit(EXIT_FAILURE);
         }
     }
 } // namespace exchange::modules
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "core/instrument.hpp"
 #include "core/json.hpp"
+#include "statement_cache.hpp"
 #include <SQLiteCpp/SQLiteCpp.h>
 
 namespace exchange::modules
@@ -15,7 +17,7 @@ namespace exchange::modules
     {
         uint64_t id;
         std::string currency;
-        float amount;
+        int64_t amount;
     };
 
     NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(exchange::modules::WalletInfo, id, currency, amount)
@@ -25,16 +27,26 @@ namespace exchange::modules
       public:
         Wallet(SQLite::Database& database, std::optional<std::filesystem::path> const log_path);
 
-        ~Wallet();
-
         auto create_wallet(uint64_t const user_id, std::string_view const currency, uint64_t& wallet_id) -> bool;
 
-        auto make_transaction(uint64_t const wallet_id, float const amount,
+        auto make_transaction(uint64_t const wallet_id, int64_t const amount,
                               WalletTransactionType const transaction_type, std::string_view const description) -> bool;
 
         auto wallets(uint64_t const user_id) -> std::optional<std::vector<WalletInfo>>;
 
+        auto find_wallet(uint64_t const user_id, core::CurrencyId const currency, uint64_t& wallet_id) -> bool;
+
+        auto statement_stats() const -> StatementCache::Stats;
+
       private:
         SQLite::Database* m_database;
+        StatementCache m_statements;
+
+        // Wallet ids by user and currency id, zero while the wallet is not known yet
+        std::unordered_map<uint64_t, std::array<uint64_t, core::currencies.size()>> m_wallet_ids;
+
+        auto rebuild_balances() -> void;
+
+        auto upgrade_transactions() -> void;
     };
 } // namespace exchange::modules
\ No newline at end of file
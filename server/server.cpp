@@ -3,9 +3,12 @@
 
 namespace exchange
 {
-    Server::Server(uint32_t const port, std::filesystem::path const& log_path)
-        : m_acceptor(m_io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
-          m_session_index(0), m_core(log_path)
+    Server::Server(uint32_t const port, std::filesystem::path const& log_path,
+                   std::chrono::milliseconds const opening_auction, modules::StorageSettings const& storage,
+                   modules::CompactionSettings const& compaction, uint32_t const threads)
+        : m_threads(std::max(threads, 1u)), m_io_context(static_cast<int32_t>(m_threads)),
+          m_acceptor(m_io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
+          m_session_index(0), m_core(log_path, storage, compaction), m_opening_auction(opening_auction)
     {
         std::vector<spdlog::sink_ptr> sinks{
             std::make_shared<spdlog::sinks::stdout_color_sink_mt>(),
@@ -21,26 +24,51 @@ namespace exchange
 
     auto Server::run() -> void
     {
-        spdlog::get("server")->log(spdlog::level::info, "Server is running! ::{}", m_acceptor.local_endpoint().port());
+        spdlog::get("server")->log(spdlog::level::info, "Server is running! ::{} ({} I/O threads)",
+                                   m_acceptor.local_endpoint().port(), m_threads);
 
-        m_core.start();
+        m_core.start(m_opening_auction);
 
         this->accept_connection();
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < m_threads; ++i)
+        {
+            threads.emplace_back([this]() { m_io_context.run(); });
+        }
         m_io_context.run();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
     }
 
     auto Server::accept_connection() -> void
     {
-        m_acceptor.async_accept([this](boost::system::error_code const& error, boost::asio::ip::tcp::socket&& socket) {
+        // Each socket gets a strand of its own, handlers of one session never run concurrently while sessions
+        // spread over the I/O threads
+        m_acceptor.async_accept(boost::asio::make_strand(m_io_context), [this](boost::system::error_code const& error,
+                                                                               boost::asio::ip::tcp::socket&& socket) {
             if (!error)
             {
                 auto remote_endpoint = socket.remote_endpoint();
 
-                auto session = std::make_shared<Session>(std::move(socket), m_session_index);
-                session->on_connected = [remote_endpoint, this](uint64_t const session_id) {
+                // Only one accept is pending at a time, so the index is not raced
+                auto const session_id = m_session_index++;
+                auto session = std::make_shared<Session>(std::move(socket), session_id, m_buffers);
+                session->on_connected = [remote_endpoint, this,
+                                         weak_session = std::weak_ptr(session)](uint64_t const session_id) {
                     spdlog::get("server")->log(spdlog::level::trace, "Client {}:{} is connected",
                                                remote_endpoint.address().to_string(), remote_endpoint.port());
-                    this->m_core.on_session_connected(session_id);
+
+                    // Reports may still be pushed from an engine thread while the session is being closed
+                    this->m_core.on_session_connected(session_id, [weak_session](Response const& response) {
+                        if (auto const session = weak_session.lock())
+                        {
+                            session->send(response);
+                        }
+                    });
                 };
                 session->on_closed = [remote_endpoint, this](uint64_t const session_id) {
                     spdlog::get("server")->log(spdlog::level::trace, "Client {}:{} is disconnected",
@@ -48,13 +76,17 @@ namespace exchange
                     this->m_core.on_session_closed(session_id);
                     this->close_connection(session_id);
                 };
-                session->on_message = [this](uint64_t const session_id,
-                                             std::span<uint8_t const> const buffer) -> Response {
-                    return this->m_core.on_message(session_id, buffer);
+                session->on_message = [this](uint64_t const session_id, std::span<uint8_t const> const buffer,
+                                             ResponseHandler const& on_response) -> void {
+                    this->m_core.on_message(session_id, buffer, on_response);
                 };
-                session->start();
+                {
+                    std::lock_guard lock(m_sessions_mutex);
+                    m_sessions[session_id] = session;
+                }
 
-                m_sessions[m_session_index++] = std::move(session);
+                // The first read is started on the session strand, the accept handler runs outside of it
+                boost::asio::dispatch(session->executor(), [session]() { session->start(); });
 
                 this->accept_connection();
             }
@@ -63,6 +95,7 @@ namespace exchange
 
     auto Server::close_connection(uint64_t const session_id) -> void
     {
+        std::lock_guard lock(m_sessions_mutex);
         m_sessions.erase(session_id);
     }
 } // namespace exchange
\ No newline at end of file
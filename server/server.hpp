@@ -8,18 +8,29 @@ namespace exchange
     class Server
     {
       public:
-        Server(uint32_t const port, std::filesystem::path const& log_path);
+        Server(uint32_t const port, std::filesystem::path const& log_path,
+               std::chrono::milliseconds const opening_auction, modules::StorageSettings const& storage,
+               modules::CompactionSettings const& compaction, uint32_t const threads);
 
+        // Runs the I/O threads until the server is stopped, the calling thread is one of them
         auto run() -> void;
 
       private:
+        uint32_t m_threads;
+
+        // Shared by the sessions, so only connections with traffic in flight hold buffers
+        core::BufferPool m_buffers;
+
         boost::asio::io_context m_io_context;
         boost::asio::ip::tcp::acceptor m_acceptor;
 
+        // Sessions are closed on their own strands, so the map is shared between the I/O threads
+        std::mutex m_sessions_mutex;
         std::unordered_map<uint64_t, std::shared_ptr<Session>> m_sessions;
         uint64_t m_session_index;
 
         Core m_core;
+        std::chrono::milliseconds m_opening_auction;
 
         auto accept_connection() -> void;
 
@@ -9,24 +9,23 @@ namespace exchange
     {
     }
 
-    Session::Session(boost::asio::ip::tcp::socket&& socket, uint64_t const m_session_id)
-        : m_socket(std::move(socket)), m_write_buffer(2048), m_read_buffer(2048), m_session_id(m_session_id)
+    auto Response::correlate(std::optional<uint64_t> const request_id) -> Response&
     {
+        m_request_id = request_id;
+        return *this;
     }
 
-    Session::Session(Session&& other)
-        : m_socket(std::move(other.m_socket)), m_write_buffer(std::move(other.m_write_buffer)),
-          m_read_buffer(std::move(other.m_read_buffer)), m_session_id(other.m_session_id)
-    {
-    }
+    // Bytes asked from the socket per read, a larger message just takes several
+    constexpr size_t read_size = 4096;
 
-    auto Session::operator=(Session&& other) -> Session&
+    // Responses a client may leave unread before the session stops reading its requests
+    constexpr size_t write_queue_limit = 1024 * 1024;
+
+    Session::Session(boost::asio::ip::tcp::socket&& socket, uint64_t const m_session_id,
+                     core::BufferPool& buffers)
+        : m_socket(std::move(socket)), m_buffers(&buffers), m_session_id(m_session_id), m_closed(false),
+          m_queued_bytes(0), m_reading_paused(false)
     {
-        m_socket = std::move(other.m_socket);
-        m_write_buffer = std::move(other.m_write_buffer);
-        m_read_buffer = std::move(other.m_read_buffer);
-        m_session_id = other.m_session_id;
-        return *this;
     }
 
     uint64_t Session::session_id() const
@@ -34,6 +33,11 @@ namespace exchange
         return m_session_id;
     }
 
+    auto Session::executor() -> boost::asio::any_io_executor
+    {
+        return m_socket.get_executor();
+    }
+
     auto Session::start() -> void
     {
         if (on_connected)
@@ -41,49 +45,189 @@ namespace exchange
             on_connected(m_session_id);
         }
 
+        // Reads only take what has already arrived, the wait for more is asynchronous
+        boost::system::error_code error;
+        m_socket.non_blocking(true, error);
+
         this->read_socket();
     }
 
     auto Session::read_socket() -> void
     {
-        m_socket.async_read_some(boost::asio::buffer(m_read_buffer),
-                                 [this](boost::system::error_code const& error, size_t const size) -> void {
-                                     if (!error)
-                                     {
-                                         if (on_message)
-                                         {
-                                             Response response = this->on_message(
-                                                 m_session_id, std::span<uint8_t>(m_read_buffer.data(), size));
-
-                                             nlohmann::json packet;
-                                             packet["type"] = static_cast<uint16_t>(response.m_message_type);
-                                             packet["payload"] = response.m_payload;
-
-                                             std::string const request = packet.dump();
-                                             m_write_buffer.assign(request.begin(), request.end());
-                                         }
-
-                                         this->write_socket();
-                                     }
-                                     else
-                                     {
-                                         this->on_closed(m_session_id);
-                                     }
-                                 });
+        if (m_reader.empty())
+        {
+            m_buffers->release(m_reader.release());
+        }
+
+        m_socket.async_wait(boost::asio::ip::tcp::socket::wait_read,
+                            [self = this->shared_from_this()](boost::system::error_code const& error) -> void {
+                                if (!error)
+                                {
+                                    self->receive();
+                                }
+                                else
+                                {
+                                    self->close();
+                                }
+                            });
+    }
+
+    auto Session::receive() -> void
+    {
+        if (m_reader.empty())
+        {
+            m_reader.reset(m_buffers->acquire());
+        }
+
+        auto const buffer = m_reader.prepare(read_size);
+
+        boost::system::error_code error;
+        size_t const size = m_socket.read_some(boost::asio::buffer(buffer.data(), buffer.size()), error);
+        if (error == boost::asio::error::would_block)
+        {
+            this->read_socket();
+        }
+        else if (error)
+        {
+            this->close();
+        }
+        else
+        {
+            m_reader.commit(size);
+            this->process_messages();
+        }
+    }
+
+    auto Session::process_messages() -> void
+    {
+        // Every complete message is dispatched at once, their responses are queued as they complete
+        while (m_queued_bytes <= write_queue_limit)
+        {
+            auto const message = m_reader.next();
+            if (!message)
+            {
+                break;
+            }
+
+            if (on_message)
+            {
+                this->on_message(m_session_id, message.value(),
+                                 [self = this->shared_from_this()](Response const& response) { self->send(response); });
+            }
+        }
+
+        if (m_reader.failed())
+        {
+            spdlog::get("server")->log(spdlog::level::warn, "Session {} sent a message over {} bytes",
+                                       m_session_id, core::max_frame_size);
+            this->close();
+            return;
+        }
+
+        if (m_closed)
+        {
+            return;
+        }
+
+        // A client not reading its responses is not read either, the writes resume it once they catch up
+        if (m_queued_bytes > write_queue_limit)
+        {
+            m_reading_paused = true;
+            return;
+        }
+
+        this->read_socket();
     }
 
     auto Session::write_socket() -> void
     {
-        boost::asio::async_write(m_socket, boost::asio::buffer(m_write_buffer),
-                                 [this](boost::system::error_code const& error, size_t const size) -> void {
-                                     if (!error)
-                                     {
-                                         this->read_socket();
-                                     }
-                                     else
-                                     {
-                                         this->on_closed(m_session_id);
-                                     }
-                                 });
+        std::swap(m_write_buffers, m_write_queue);
+
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.reserve(m_write_buffers.size());
+        for (auto const& buffer : m_write_buffers)
+        {
+            buffers.emplace_back(boost::asio::buffer(buffer));
+        }
+
+        boost::asio::async_write(
+            m_socket, buffers,
+            [self = this->shared_from_this()](boost::system::error_code const& error, size_t const size) -> void {
+                if (error)
+                {
+                    self->close();
+                    return;
+                }
+
+                for (auto& buffer : self->m_write_buffers)
+                {
+                    self->m_queued_bytes -= buffer.size();
+                    self->m_buffers->release(std::move(buffer));
+                }
+                self->m_write_buffers.clear();
+
+                if (!self->m_write_queue.empty())
+                {
+                    self->write_socket();
+                }
+
+                if (self->m_reading_paused && self->m_queued_bytes <= write_queue_limit)
+                {
+                    self->m_reading_paused = false;
+                    self->process_messages();
+                }
+            });
+    }
+
+    auto Session::close() -> void
+    {
+        if (m_closed)
+        {
+            return;
+        }
+        m_closed = true;
+
+        // Pending reads and writes complete with an error and find the session already closed
+        boost::system::error_code error;
+        m_socket.close(error);
+
+        m_buffers->release(m_reader.release());
+
+        if (on_closed)
+        {
+            on_closed(m_session_id);
+        }
+    }
+
+    auto Session::send(Response const& response) -> void
+    {
+        nlohmann::json packet;
+        packet["type"] = static_cast<uint16_t>(response.m_message_type);
+        packet["payload"] = response.m_payload;
+        if (response.m_request_id)
+        {
+            packet["id"] = response.m_request_id.value();
+        }
+
+        // Serialized on the calling thread straight into the buffer the socket writes from
+        auto buffer = m_buffers->acquire();
+        core::frame(packet, buffer);
+
+        // Responses may be completed on a matching engine thread, the socket is only touched on its own executor
+        boost::asio::post(m_socket.get_executor(),
+                          [self = this->shared_from_this(), response = std::move(buffer)]() mutable {
+                              if (self->m_closed)
+                              {
+                                  self->m_buffers->release(std::move(response));
+                                  return;
+                              }
+
+                              self->m_queued_bytes += response.size();
+                              self->m_write_queue.emplace_back(std::move(response));
+                              if (self->m_write_buffers.empty())
+                              {
+                                  self->write_socket();
+                              }
+                          });
     }
 } // namespace exchange
\ No newline at end of file
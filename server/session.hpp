@@ -1,6 +1,8 @@
 #pragma once
 
+#include "core/buffer_pool.hpp"
 #include "core/common.hpp"
+#include "core/framing.hpp"
 #include "core/json.hpp"
 
 namespace exchange
@@ -12,42 +14,74 @@ namespace exchange
       public:
         Response(core::RequestMessageType const message_type, std::optional<nlohmann::json> payload);
 
+        // Echoes the id the client sent with its request, if any
+        auto correlate(std::optional<uint64_t> const request_id) -> Response&;
+
       private:
         core::RequestMessageType m_message_type;
         nlohmann::json m_payload;
+        std::optional<uint64_t> m_request_id;
     };
 
-    class Session
+    using ResponseHandler = std::function<void(Response const&)>;
+
+    // Reads requests while earlier ones are still being answered, responses are written in the order they complete
+    class Session : public std::enable_shared_from_this<Session>
     {
       public:
-        Session(boost::asio::ip::tcp::socket&& socket, uint64_t const sessionID);
+        // Read and write buffers are borrowed from buffers only while in use, it must outlive the session
+        Session(boost::asio::ip::tcp::socket&& socket, uint64_t const sessionID, core::BufferPool& buffers);
 
         Session(Session const& other) = delete;
 
-        Session(Session&& other);
+        // Pending reads and writes hold the session, so it stays where it was created
+        Session(Session&& other) = delete;
 
         auto operator=(Session const& other) -> Session& = delete;
 
-        auto operator=(Session&& other) -> Session&;
+        auto operator=(Session&& other) -> Session& = delete;
 
         auto start() -> void;
 
         uint64_t session_id() const;
 
+        // The strand of the socket, every handler of the session runs on it
+        auto executor() -> boost::asio::any_io_executor;
+
         std::function<void(uint64_t const)> on_connected;
 
         std::function<void(uint64_t const)> on_closed;
 
-        std::function<Response(uint64_t const, std::span<uint8_t const> const)> on_message;
+        std::function<void(uint64_t const, std::span<uint8_t const> const, ResponseHandler const&)> on_message;
+
+        // Queues a response or a message pushed by the server, from any thread
+        auto send(Response const& response) -> void;
 
       private:
         uint64_t m_session_id;
         boost::asio::ip::tcp::socket m_socket;
-        std::vector<uint8_t> m_read_buffer;
-        std::vector<uint8_t> m_write_buffer;
+        core::BufferPool* m_buffers;
+        core::FrameReader m_reader;
+        bool m_closed;
+
+        // Responses queued while a write is in progress go out together with the next one
+        std::vector<std::vector<uint8_t>> m_write_queue;
+        std::vector<std::vector<uint8_t>> m_write_buffers;
 
+        // Bytes of both, past write_queue_limit requests are left unread until the client reads its responses
+        size_t m_queued_bytes;
+        bool m_reading_paused;
+
+        // Waits until the socket is readable, so a session waiting for requests holds no read buffer
         auto read_socket() -> void;
 
+        auto receive() -> void;
+
+        // Handles every buffered message, then reads more
+        auto process_messages() -> void;
+
         auto write_socket() -> void;
+
+        auto close() -> void;
     };
 } // namespace exchange
\ No newline at end of file
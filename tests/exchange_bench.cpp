@@ -0,0 +1,105 @@
+#include "modules/exchange.hpp"
+#include "modules/storage.hpp"
+#include "modules/wallet.hpp"
+#include "precompiled.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <benchmark/benchmark.h>
+
+using namespace exchange;
+
+constexpr core::InstrumentId USD_RUB = core::find_instrument("USD/RUB")->id;
+
+// Resting requests are quoted around this price, one tick apart
+constexpr int64_t mid_price = 6200;
+constexpr int64_t resting_amount = 100;
+
+// Arguments: book depth per side, crossing requests (%), partial fills among them (%), number of users,
+// storage backend (0 for the database file, 1 for memory)
+static auto BM_MakeAndProcessRequests(benchmark::State& state) -> void
+{
+    int64_t const depth = state.range(0);
+    int64_t const crossing_ratio = state.range(1);
+    int64_t const partial_ratio = state.range(2);
+    uint64_t const users = static_cast<uint64_t>(state.range(3));
+    auto const backend = static_cast<modules::BackendType>(state.range(4));
+
+    auto const storage = modules::StorageBackend::create(
+        modules::StorageSettings{.backend = backend, .path = "bench.db"}, std::nullopt);
+    auto bench_db = storage->open();
+    bench_db.exec("DROP TABLE IF EXISTS requests");
+    bench_db.exec("DROP TABLE IF EXISTS wallets");
+    bench_db.exec("DROP TABLE IF EXISTS transactions");
+
+    modules::Exchange exchange(bench_db, std::nullopt);
+    modules::Wallet wallet(bench_db, std::nullopt);
+
+    for (uint64_t const user_id : std::views::iota(1ull, users + 1))
+    {
+        uint64_t new_wallet_id;
+        wallet.create_wallet(user_id, "RUB", new_wallet_id);
+        wallet.create_wallet(user_id, "USD", new_wallet_id);
+    }
+
+    // The same seed keeps the request stream identical between runs
+    std::mt19937_64 random(depth ^ (crossing_ratio << 16) ^ (partial_ratio << 32) ^ (users << 48));
+    std::uniform_int_distribution<int64_t> percent(0, 99);
+    std::uniform_int_distribution<int64_t> level(1, depth);
+    std::uniform_int_distribution<uint64_t> user(1, users);
+
+    for (int64_t const i : std::views::iota(int64_t{1}, depth + 1))
+    {
+        exchange.make_request(user(random), USD_RUB, resting_amount, mid_price - i, modules::RequestType::Buy);
+        exchange.make_request(user(random), USD_RUB, resting_amount, mid_price + i, modules::RequestType::Sell);
+    }
+
+    std::vector<double> latencies;
+    for (auto _ : state)
+    {
+        bool const is_buy = percent(random) < 50;
+        bool const is_crossing = percent(random) < crossing_ratio;
+        bool const is_partial = percent(random) < partial_ratio;
+
+        // Crossing requests reach the far end of the book but their amount only takes the best level
+        int64_t const offset = is_crossing ? -(depth + 1) : level(random);
+        int64_t const price = is_buy ? mid_price - offset : mid_price + offset;
+        int64_t const amount = is_crossing && is_partial ? resting_amount / 2 : resting_amount;
+
+        auto const started = std::chrono::steady_clock::now();
+        exchange.make_request(user(random), USD_RUB, amount, price,
+                              is_buy ? modules::RequestType::Buy : modules::RequestType::Sell);
+        exchange.process_requests(wallet);
+        latencies.emplace_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started)
+                                   .count());
+    }
+
+    state.counters["orders/s"] =
+        benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+
+    std::sort(latencies.begin(), latencies.end());
+    for (auto const& [name, quantile] :
+         {std::pair{"p50_us", 0.5}, std::pair{"p99_us", 0.99}, std::pair{"p999_us", 0.999}})
+    {
+        state.counters[name] = latencies[static_cast<size_t>(quantile * (latencies.size() - 1))];
+    }
+}
+
+BENCHMARK(BM_MakeAndProcessRequests)
+    ->ArgNames({"depth", "crossing", "partial", "users", "backend"})
+    ->ArgsProduct({{10, 1000}, {0, 50, 100}, {0, 50}, {2, 100}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    // Fills are logged at debug level, which would be measured along with them
+    spdlog::set_level(spdlog::level::warn);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,33 @@
+#include "core/buffer_pool.hpp"
+#include "core/framing.hpp"
+#include "modules/event_writer.hpp"
 #include "modules/exchange.hpp"
+#include "modules/journal.hpp"
+#include "modules/ledger_compactor.hpp"
+#include "modules/login.hpp"
+#include "modules/matching_engine.hpp"
+#include "modules/order_pool.hpp"
+#include "modules/schema.hpp"
+#include "modules/snapshot.hpp"
+#include "modules/statement_cache.hpp"
+#include "modules/storage.hpp"
 #include "modules/wallet.hpp"
+#include "packets/exchange.hpp"
+#include "pipeline.hpp"
 #include "precompiled.hpp"
+#include "session.hpp"
 #include <SQLiteCpp/SQLiteCpp.h>
 #include <gtest/gtest.h>
+#include <sqlite3.h>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#endif
 
 using namespace exchange;
 
+constexpr core::InstrumentId USD_RUB = core::find_instrument("USD/RUB")->id;
+
 TEST(Exchange, MakeRequest_Test)
 {
     SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
@@ -17,16 +39,16 @@ TEST(Exchange, MakeRequest_Test)
 
     modules::Exchange exchange(test_db, std::nullopt);
 
-    ASSERT_TRUE(exchange.make_request(1, "USD/RUB", 50, 62, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(2, "USD/RUB", 40, 70, modules::RequestType::Sell));
-    ASSERT_TRUE(exchange.make_request(3, "USD/RUB", 120, 100, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(1, USD_RUB, 5000, 6200, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 4000, 7000, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(3, USD_RUB, 12000, 10000, modules::RequestType::Sell));
 
     {
         SQLite::Statement statement(test_db, "SELECT currency, amount, price, request_type FROM requests WHERE id = 1");
         ASSERT_TRUE(statement.executeStep());
         ASSERT_EQ(statement.getColumn(0).getString(), "USD/RUB");
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
-        ASSERT_EQ(statement.getColumn(2).getDouble(), 62);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
+        ASSERT_EQ(statement.getColumn(2).getInt64(), 62 * 100);
         ASSERT_EQ(statement.getColumn(3).getUInt(), static_cast<uint32_t>(modules::RequestType::Buy));
     }
 }
@@ -42,9 +64,9 @@ TEST(Exchange, RemoveRequest_Test)
 
     modules::Exchange exchange(test_db, std::nullopt);
 
-    ASSERT_TRUE(exchange.make_request(1, "USD/RUB", 50, 62, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(2, "USD/RUB", 40, 70, modules::RequestType::Sell));
-    ASSERT_TRUE(exchange.make_request(3, "USD/RUB", 120, 100, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(1, USD_RUB, 5000, 6200, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 4000, 7000, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(3, USD_RUB, 12000, 10000, modules::RequestType::Sell));
 
     {
         SQLite::Statement statement(test_db, "SELECT * FROM requests");
@@ -95,11 +117,11 @@ TEST(Exchange, ProcessEqRequests_Test)
         ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
     }
 
-    ASSERT_TRUE(exchange.make_request(1, "USD/RUB", 50, 62, modules::RequestType::Sell));
-    ASSERT_TRUE(exchange.make_request(2, "USD/RUB", 50, 63, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(3, "USD/RUB", 50, 64, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(4, "USD/RUB", 50, 60, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(5, "USD/RUB", 50, 61, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(1, USD_RUB, 5000, 6200, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 5000, 6300, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(3, USD_RUB, 5000, 6400, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(4, USD_RUB, 5000, 6000, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(5, USD_RUB, 5000, 6100, modules::RequestType::Sell));
 
     exchange.process_requests(wallet);
 
@@ -107,62 +129,64 @@ TEST(Exchange, ProcessEqRequests_Test)
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0 "
+                     "ORDER BY transactions.id");
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 64);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 64 * 100);
 
         // User (id: 5)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 5);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 63);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 63 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
     }
 
     // Deposit Testing
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1 "
+                     "ORDER BY transactions.id");
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
 
         // User (id: 5)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 5);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 64);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 64 * 100);
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 63);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 63 * 100);
     }
 
     // Wallet Testing
@@ -177,8 +201,8 @@ TEST(Exchange, ProcessEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, 3150.0f);
-        ASSERT_EQ(USD_wallet->amount, -50.0f);
+        ASSERT_EQ(RUB_wallet->amount, 315000);
+        ASSERT_EQ(USD_wallet->amount, -5000);
     }
 
     // User (id: 2)
@@ -191,8 +215,8 @@ TEST(Exchange, ProcessEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -3150.0f);
-        ASSERT_EQ(USD_wallet->amount, 50.0f);
+        ASSERT_EQ(RUB_wallet->amount, -315000);
+        ASSERT_EQ(USD_wallet->amount, 5000);
     }
 
     // User (id: 3)
@@ -205,8 +229,8 @@ TEST(Exchange, ProcessEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -3200.0f);
-        ASSERT_EQ(USD_wallet->amount, 50.0f);
+        ASSERT_EQ(RUB_wallet->amount, -320000);
+        ASSERT_EQ(USD_wallet->amount, 5000);
     }
 
     // User (id: 4)
@@ -219,8 +243,8 @@ TEST(Exchange, ProcessEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, 0.0f);
-        ASSERT_EQ(USD_wallet->amount, 0.0f);
+        ASSERT_EQ(RUB_wallet->amount, 0);
+        ASSERT_EQ(USD_wallet->amount, 0);
     }
 
     // User (id: 5)
@@ -233,8 +257,8 @@ TEST(Exchange, ProcessEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, 3200.0f);
-        ASSERT_EQ(USD_wallet->amount, -50.0f);
+        ASSERT_EQ(RUB_wallet->amount, 320000);
+        ASSERT_EQ(USD_wallet->amount, -5000);
     }
 }
 
@@ -268,10 +292,10 @@ TEST(Exchange, ProcessNotEqRequests_Test)
         ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
     }
 
-    ASSERT_TRUE(exchange.make_request(1, "USD/RUB", 100, 62, modules::RequestType::Sell));
-    ASSERT_TRUE(exchange.make_request(2, "USD/RUB", 50, 63, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(3, "USD/RUB", 40, 64, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(4, "USD/RUB", 50, 62, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(1, USD_RUB, 10000, 6200, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 5000, 6300, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(3, USD_RUB, 4000, 6400, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(4, USD_RUB, 5000, 6200, modules::RequestType::Buy));
 
     exchange.process_requests(wallet);
 
@@ -279,86 +303,88 @@ TEST(Exchange, ProcessNotEqRequests_Test)
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0 "
+                     "ORDER BY transactions.id");
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 40 * 64);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 40 * 64 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 40);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 40 * 100);
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 63);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 63 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
 
         // User (id: 4)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 4);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10 * 62);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 62 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 100);
     }
 
     // Deposit Testing
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1 "
+                     "ORDER BY transactions.id");
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 40);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 40 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 40 * 64);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 40 * 64 * 100);
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 50 * 63);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 63 * 100);
 
         // User (id: 4)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 4);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10 * 62);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 62 * 100);
     }
 
     // Wallet Testing
@@ -373,8 +399,8 @@ TEST(Exchange, ProcessNotEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, 6330.0f);
-        ASSERT_EQ(USD_wallet->amount, -100.0f);
+        ASSERT_EQ(RUB_wallet->amount, 633000);
+        ASSERT_EQ(USD_wallet->amount, -10000);
     }
 
     // User (id: 2)
@@ -387,8 +413,8 @@ TEST(Exchange, ProcessNotEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -3150.0f);
-        ASSERT_EQ(USD_wallet->amount, 50.0f);
+        ASSERT_EQ(RUB_wallet->amount, -315000);
+        ASSERT_EQ(USD_wallet->amount, 5000);
     }
 
     // User (id: 3)
@@ -401,8 +427,8 @@ TEST(Exchange, ProcessNotEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -2560.0f);
-        ASSERT_EQ(USD_wallet->amount, 40.0f);
+        ASSERT_EQ(RUB_wallet->amount, -256000);
+        ASSERT_EQ(USD_wallet->amount, 4000);
     }
 
     // User (id: 4)
@@ -415,8 +441,8 @@ TEST(Exchange, ProcessNotEqRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -620.0f);
-        ASSERT_EQ(USD_wallet->amount, 10.0f);
+        ASSERT_EQ(RUB_wallet->amount, -62000);
+        ASSERT_EQ(USD_wallet->amount, 1000);
     }
 }
 
@@ -450,9 +476,9 @@ TEST(Exchange, ProcessPartialRequests_Test)
         ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
     }
 
-    ASSERT_TRUE(exchange.make_request(1, "USD/RUB", 10, 62, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(2, "USD/RUB", 20, 63, modules::RequestType::Buy));
-    ASSERT_TRUE(exchange.make_request(3, "USD/RUB", 50, 61, modules::RequestType::Sell));
+    ASSERT_TRUE(exchange.make_request(1, USD_RUB, 1000, 6200, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 2000, 6300, modules::RequestType::Buy));
+    ASSERT_TRUE(exchange.make_request(3, USD_RUB, 5000, 6100, modules::RequestType::Sell));
 
     exchange.process_requests(wallet);
 
@@ -460,62 +486,64 @@ TEST(Exchange, ProcessPartialRequests_Test)
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 0 "
+                     "ORDER BY transactions.id");
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 63 * 20);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 63 * 20 * 100);
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 20);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 20 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 62 * 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 62 * 10 * 100);
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 100);
     }
 
     // Deposit Testing
     {
         SQLite::Statement statement(
             test_db, "SELECT wallets.user_id AS user_id, amount FROM transactions "
-                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1");
+                     "INNER JOIN wallets ON transactions.wallet_id = wallets.id WHERE transaction_type = 1 "
+                     "ORDER BY transactions.id");
 
         // User (id: 2)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 20);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 20 * 100);
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 63 * 20);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 63 * 20 * 100);
 
         // User (id: 1)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 100);
 
         // User (id: 3)
         ASSERT_TRUE(statement.executeStep());
 
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 62 * 10);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 62 * 10 * 100);
     }
 
     // Requests Testing
@@ -525,7 +553,102 @@ TEST(Exchange, ProcessPartialRequests_Test)
         // Request (id: 3, user_id: 3)
         ASSERT_TRUE(statement.executeStep());
         ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
-        ASSERT_EQ(statement.getColumn(1).getDouble(), 20);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 20 * 100);
+    }
+
+    // Wallet Testing
+
+    // User (id: 1)
+    {
+        auto const wallets = wallet.wallets(1).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, -62000);
+        ASSERT_EQ(USD_wallet->amount, 1000);
+    }
+
+    // User (id: 2)
+    {
+        auto const wallets = wallet.wallets(2).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, -126000);
+        ASSERT_EQ(USD_wallet->amount, 2000);
+    }
+
+    // User (id: 3)
+    {
+        auto const wallets = wallet.wallets(3).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, 188000);
+        ASSERT_EQ(USD_wallet->amount, -3000);
+    }
+}
+
+TEST(Exchange, RestoreRequests_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 3u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    {
+        modules::Exchange exchange(test_db, std::nullopt);
+
+        ASSERT_TRUE(exchange.make_request(1, USD_RUB, 3000, 6200, modules::RequestType::Sell));
+        ASSERT_TRUE(exchange.make_request(2, USD_RUB, 5000, 6300, modules::RequestType::Buy));
+    }
+
+    // Order book is rebuilt from the requests table
+    modules::Exchange exchange(test_db, std::nullopt);
+    exchange.process_requests(wallet);
+
+    // Requests Testing
+    {
+        SQLite::Statement statement(test_db, "SELECT user_id, amount FROM requests");
+
+        // Request (id: 2, user_id: 2)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 20 * 100);
+        ASSERT_FALSE(statement.executeStep());
     }
 
     // Wallet Testing
@@ -540,8 +663,8 @@ TEST(Exchange, ProcessPartialRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -620.0f);
-        ASSERT_EQ(USD_wallet->amount, 10.0f);
+        ASSERT_EQ(RUB_wallet->amount, 189000);
+        ASSERT_EQ(USD_wallet->amount, -3000);
     }
 
     // User (id: 2)
@@ -554,8 +677,81 @@ TEST(Exchange, ProcessPartialRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, -1260.0f);
-        ASSERT_EQ(USD_wallet->amount, 20.0f);
+        ASSERT_EQ(RUB_wallet->amount, -189000);
+        ASSERT_EQ(USD_wallet->amount, 3000);
+    }
+}
+
+TEST(Exchange, SubmitOrder_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Exchange exchange(test_db, std::nullopt);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 6u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    uint64_t request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 5000, 6300, modules::RequestType::Buy, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 5000, 6400, modules::RequestType::Buy, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 4, USD_RUB, 5000, 6000, modules::RequestType::Buy, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 5, USD_RUB, 5000, 6100, modules::RequestType::Sell, request_id));
+
+    // A request worth more than an int64_t is rejected before it can reach the book
+    auto const& instrument = *core::find_instrument(USD_RUB);
+    int64_t const max_amount = std::numeric_limits<int64_t>::max() / 6200;
+    ASSERT_EQ(core::notional(instrument, max_amount, 6200), max_amount * 6200 / 100);
+    ASSERT_FALSE(core::notional(instrument, max_amount + 1, 6200));
+    ASSERT_FALSE(
+        exchange.submit_order(wallet, 1, USD_RUB, max_amount + 1, 6200, modules::RequestType::Sell, request_id));
+
+    // Requests Testing
+    {
+        SQLite::Statement statement(test_db, "SELECT user_id, amount FROM requests");
+
+        // Request (id: 4, user_id: 4)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 4);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 50 * 100);
+        ASSERT_FALSE(statement.executeStep());
+    }
+
+    // Wallet Testing
+
+    // User (id: 1)
+    {
+        auto const wallets = wallet.wallets(1).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, 315000);
+        ASSERT_EQ(USD_wallet->amount, -5000);
     }
 
     // User (id: 3)
@@ -568,9 +764,1980 @@ TEST(Exchange, ProcessPartialRequests_Test)
         auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
                                        [&](auto const& element) { return element.currency.compare("USD") == 0; });
 
-        ASSERT_EQ(RUB_wallet->amount, 1880.0f);
-        ASSERT_EQ(USD_wallet->amount, -30.0f);
+        ASSERT_EQ(RUB_wallet->amount, -320000);
+        ASSERT_EQ(USD_wallet->amount, 5000);
+    }
+
+    // User (id: 5)
+    {
+        auto const wallets = wallet.wallets(5).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, 320000);
+        ASSERT_EQ(USD_wallet->amount, -5000);
+    }
+}
+
+TEST(Exchange, UpgradeRequests_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "CREATE TABLE requests (id INTEGER PRIMARY KEY, user_id INTEGER, "
+                                             "currency TEXT, amount REAL, price REAL, request_type INTEGER)");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "INSERT INTO requests (user_id, currency, amount, price, request_type) "
+                                             "VALUES (1, 'USD/RUB', 12.5, 62.07, 0)");
+        ASSERT_EQ(statement.exec(), 1);
+    }
+
+    modules::Exchange exchange(test_db, std::nullopt);
+
+    {
+        SQLite::Statement statement(test_db, "SELECT amount, price FROM requests WHERE id = 1");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 1250);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 6207);
+    }
+}
+
+TEST(Exchange, SharedLoggers_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    // Every engine has an exchange of its own, and the ones left still log once another is gone
+    modules::Exchange exchange(test_db, std::nullopt, core::instruments, nullptr);
+    {
+        modules::Exchange other(test_db, std::nullopt, core::instruments, nullptr);
+    }
+    ASSERT_NE(spdlog::get("exchange"), nullptr);
+    ASSERT_FALSE(exchange.make_request(1, core::InstrumentId(1000), 5000, 6200, modules::RequestType::Buy));
+}
+
+TEST(Exchange, MatchingEngine_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 3u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    {
+        modules::MatchingEngine engine(
+            modules::SQLiteBackend(modules::StorageSettings{.path = "test.db"}, std::nullopt),
+            *core::find_instrument("USD/RUB"), std::nullopt);
+        engine.start();
+
+        std::vector<std::future<bool>> results;
+        for (auto const& [user_id, amount, price, request_type] :
+             {std::tuple(1, 3000, 6200, modules::RequestType::Sell),
+              std::tuple(2, 5000, 6300, modules::RequestType::Buy)})
+        {
+            auto promise = std::make_shared<std::promise<bool>>();
+            results.emplace_back(promise->get_future());
+            engine.submit_order(user_id, amount, price, request_type,
+                                [promise](bool const successful, uint64_t const request_id) {
+                                    promise->set_value(successful);
+                                });
+        }
+
+        for (auto& result : results)
+        {
+            ASSERT_TRUE(result.get());
+        }
+    }
+
+    // Requests Testing
+    {
+        SQLite::Statement statement(test_db, "SELECT user_id, amount FROM requests");
+
+        // Request (id: 2, user_id: 2)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 20 * 100);
+        ASSERT_FALSE(statement.executeStep());
+    }
+
+    // Wallet Testing
+
+    // User (id: 1)
+    {
+        auto const wallets = wallet.wallets(1).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, 189000);
+        ASSERT_EQ(USD_wallet->amount, -3000);
+    }
+}
+
+TEST(Exchange, CancelRequest_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Exchange exchange(test_db, std::nullopt);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
     }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 4u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    uint64_t first_request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell,
+                                      first_request_id));
+    uint64_t second_request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 5000, 6300, modules::RequestType::Sell,
+                                      second_request_id));
+
+    // Only the owner can cancel a request
+    ASSERT_FALSE(exchange.cancel_request(2, first_request_id));
+    ASSERT_TRUE(exchange.cancel_request(1, first_request_id));
+    ASSERT_FALSE(exchange.cancel_request(1, first_request_id));
+    ASSERT_TRUE(exchange.flush_cancels());
+
+    uint64_t request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 5000, 6300, modules::RequestType::Buy, request_id));
+
+    // Requests Testing
+    {
+        SQLite::Statement statement(test_db, "SELECT COUNT(*) FROM requests");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 0);
+    }
+
+    // Wallet Testing
+
+    // User (id: 1)
+    {
+        auto const wallets = wallet.wallets(1).value();
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(USD_wallet->amount, 0);
+    }
+
+    // User (id: 2)
+    {
+        auto const wallets = wallet.wallets(2).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, 315000);
+        ASSERT_EQ(USD_wallet->amount, -5000);
+    }
+}
+
+TEST(Exchange, OrderPool_Test)
+{
+    modules::OrderPool pool(2);
+
+    modules::Order const order{
+        .request_id = 1, .user_id = 1, .amount = 5000, .price = 6200, .request_type = modules::RequestType::Buy};
+
+    pool.allocate(order);
+    auto const second_order = pool.allocate(order);
+    pool.allocate(order);
+
+    ASSERT_EQ(pool.stats().capacity, 4);
+    ASSERT_EQ(pool.stats().used, 3);
+    ASSERT_EQ(pool.stats().slabs, 2);
+
+    // Released orders are handed out again before the pool grows
+    pool.release(second_order);
+    ASSERT_EQ(pool.allocate(order), second_order);
+    ASSERT_EQ(second_order->amount, 5000);
+
+    pool.reserve(3);
+    ASSERT_EQ(pool.stats().capacity, 6);
+    ASSERT_EQ(pool.stats().slabs, 3);
+
+    {
+        modules::OrderBook book(pool);
+        book.insert(order);
+        ASSERT_EQ(pool.stats().used, 4);
+        ASSERT_TRUE(book.erase(order.request_id));
+        ASSERT_EQ(pool.stats().used, 3);
+        book.insert(order);
+    }
+
+    // Orders still resting in a book go back to the pool with it
+    ASSERT_EQ(pool.stats().used, 3);
+    ASSERT_EQ(pool.stats().capacity, 6);
+}
+
+TEST(Exchange, FindWallet_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+    modules::Wallet other_wallet(test_db, std::nullopt);
+
+    auto const& instrument = *core::find_instrument(USD_RUB);
+    ASSERT_EQ(core::find_currency(instrument.base)->name, "USD");
+    ASSERT_EQ(core::find_currency(instrument.quote)->name, "RUB");
+
+    uint64_t RUB_wallet_id;
+    ASSERT_TRUE(wallet.create_wallet(1, "RUB", RUB_wallet_id));
+
+    uint64_t wallet_id;
+    ASSERT_TRUE(wallet.find_wallet(1, instrument.quote, wallet_id));
+    ASSERT_EQ(wallet_id, RUB_wallet_id);
+    ASSERT_FALSE(wallet.find_wallet(1, instrument.base, wallet_id));
+
+    // Wallets created through another instance are picked up on the next lookup
+    uint64_t USD_wallet_id;
+    ASSERT_TRUE(other_wallet.create_wallet(1, "USD", USD_wallet_id));
+    ASSERT_TRUE(wallet.find_wallet(1, instrument.base, wallet_id));
+    ASSERT_EQ(wallet_id, USD_wallet_id);
+}
+
+TEST(Exchange, CallAuction_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS requests");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Exchange exchange(test_db, std::nullopt);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS wallets");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 5u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    ASSERT_TRUE(exchange.begin_auction(USD_RUB));
+
+    // Requests cross but only rest while the auction is called
+    uint64_t request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 1000, 6300, modules::RequestType::Buy, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 2000, 6200, modules::RequestType::Buy, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 1500, 6200, modules::RequestType::Sell, request_id));
+    ASSERT_TRUE(exchange.submit_order(wallet, 4, USD_RUB, 2000, 6150, modules::RequestType::Sell, request_id));
+
+    exchange.process_requests(wallet);
+
+    {
+        SQLite::Statement statement(test_db, "SELECT COUNT(*) FROM requests");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 4);
+    }
+
+    ASSERT_TRUE(exchange.uncross(wallet, USD_RUB));
+    ASSERT_FALSE(exchange.uncross(wallet, USD_RUB));
+
+    // Requests Testing
+    {
+        SQLite::Statement statement(test_db, "SELECT user_id, amount, price FROM requests");
+
+        // Request (id: 3, user_id: 3)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 5 * 100);
+        ASSERT_EQ(statement.getColumn(2).getInt64(), 62 * 100);
+        ASSERT_FALSE(statement.executeStep());
+    }
+
+    // Wallet Testing
+
+    // Every fill is priced at 62.00, including the buyer at 63.00 and the seller at 61.50
+    std::array<std::pair<int64_t, int64_t>, 4> const balances{
+        {{-62 * 10 * 100, 10 * 100},
+         {-62 * 20 * 100, 20 * 100},
+         {62 * 10 * 100, -10 * 100},
+         {62 * 20 * 100, -20 * 100}}};
+
+    for (uint32_t const i : std::views::iota(1u, 5u))
+    {
+        auto const wallets = wallet.wallets(i).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, balances[i - 1].first);
+        ASSERT_EQ(USD_wallet->amount, balances[i - 1].second);
+    }
+
+    // The remainder does not cross anymore, so matching carries on continuously
+    ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 500, 6200, modules::RequestType::Buy, request_id));
+
+    {
+        SQLite::Statement statement(test_db, "SELECT COUNT(*) FROM requests");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 0);
+    }
+}
+
+TEST(Exchange, Journal_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+
+    {
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        ASSERT_EQ(journal.sequence(), 0);
+
+        for (uint64_t const i : std::views::iota(1u, 4u))
+        {
+            ASSERT_EQ(journal.append(modules::JournalEvent{.type = modules::JournalEventType::Fill,
+                                                           .instrument = USD_RUB,
+                                                           .request_type = modules::RequestType::Buy,
+                                                           .request_id = i,
+                                                           .user_id = 1,
+                                                           .amount = static_cast<int64_t>(i) * 100,
+                                                           .price = 6200,
+                                                           .counter_request_id = i + 10,
+                                                           .counter_user_id = 2,
+                                                           .request_amount = 1000,
+                                                           .counter_amount = -1}),
+                      i);
+        }
+        ASSERT_EQ(journal.committed_sequence(), 0);
+        ASSERT_TRUE(journal.commit());
+        ASSERT_EQ(journal.committed_sequence(), 3);
+    }
+
+    // A torn record left by a crash
+    {
+        std::ofstream file("test_journal.bin", std::ios::binary | std::ios::app);
+        file.write("\x44\x00\x00\x00\x01\x02", 6);
+    }
+
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    ASSERT_EQ(journal.sequence(), 3);
+
+    std::vector<std::pair<uint64_t, modules::JournalEvent>> events;
+    ASSERT_TRUE(journal.replay(1, [&](uint64_t const sequence, modules::JournalEvent const& event) {
+        events.emplace_back(sequence, event);
+        return true;
+    }));
+
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].first, 2);
+    ASSERT_EQ(events[0].second.type, modules::JournalEventType::Fill);
+    ASSERT_EQ(events[0].second.request_id, 2);
+    ASSERT_EQ(events[0].second.amount, 200);
+    ASSERT_EQ(events[0].second.counter_request_id, 12);
+    ASSERT_EQ(events[0].second.counter_amount, -1);
+    ASSERT_EQ(events[1].first, 3);
+
+    ASSERT_EQ(journal.append(modules::JournalEvent{.type = modules::JournalEventType::OrderCancelled,
+                                                   .instrument = USD_RUB,
+                                                   .request_type = modules::RequestType::Sell,
+                                                   .request_id = 4,
+                                                   .user_id = 2}),
+              4);
+    ASSERT_TRUE(journal.commit());
+
+    events.clear();
+    ASSERT_TRUE(journal.replay(3, [&](uint64_t const sequence, modules::JournalEvent const& event) {
+        events.emplace_back(sequence, event);
+        return true;
+    }));
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].second.type, modules::JournalEventType::OrderCancelled);
+    ASSERT_EQ(events[0].second.request_type, modules::RequestType::Sell);
+}
+
+#ifndef _WIN32
+TEST(Exchange, JournalWriteFailure_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+
+    auto const event = [](uint64_t const request_id) {
+        return modules::JournalEvent{.type = modules::JournalEventType::OrderCancelled,
+                                     .instrument = USD_RUB,
+                                     .request_type = modules::RequestType::Sell,
+                                     .request_id = request_id,
+                                     .user_id = 1};
+    };
+
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    journal.append(event(1));
+    ASSERT_TRUE(journal.commit());
+    uintmax_t const committed_size = std::filesystem::file_size("test_journal.bin");
+
+    // The file size limit lets the next commit write only part of its block
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &limit), 0);
+    rlimit const full_limit = limit;
+    limit.rlim_cur = committed_size + committed_size / 2 * 3;
+    std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    journal.append(event(2));
+    journal.append(event(3));
+    bool const committed = journal.commit();
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &full_limit), 0);
+    std::signal(SIGXFSZ, SIG_DFL);
+
+    ASSERT_FALSE(committed);
+    ASSERT_EQ(journal.committed_sequence(), 1);
+    ASSERT_EQ(std::filesystem::file_size("test_journal.bin"), committed_size);
+
+    // The retry writes the events that failed before the ones appended since, without a torn record between
+    journal.append(event(4));
+    ASSERT_TRUE(journal.commit());
+    ASSERT_EQ(journal.committed_sequence(), 4);
+
+    std::vector<std::pair<uint64_t, uint64_t>> events;
+    ASSERT_TRUE(journal.replay(0, [&](uint64_t const sequence, modules::JournalEvent const& event) {
+        events.emplace_back(sequence, event.request_id);
+        return true;
+    }));
+    ASSERT_EQ(events, (std::vector<std::pair<uint64_t, uint64_t>>{{1, 1}, {2, 2}, {3, 3}, {4, 4}}));
+
+    std::filesystem::remove("test_journal.bin");
+}
+#endif
+
+TEST(Exchange, JournalReplay_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"requests", "wallets", "transactions", "journals"})
+    {
+        test_db.exec(std::string("DROP TABLE IF EXISTS ") + table);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 4u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    {
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+
+        uint64_t request_id;
+        ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+        ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 2000, 6300, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.commit_journal(wallet));
+
+        ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 1000, 6400, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.cancel_request(1, 1));
+
+        // The process stops after the journal was synced but before the database was updated
+        ASSERT_TRUE(journal.commit());
+    }
+
+    {
+        SQLite::Statement statement(test_db, "SELECT user_id, amount FROM requests ORDER BY id");
+
+        // Request (id: 1, user_id: 1)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 30 * 100);
+
+        // Request (id: 3, user_id: 3)
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 3);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 10 * 100);
+        ASSERT_FALSE(statement.executeStep());
+    }
+
+    for (uint32_t const attempt : std::views::iota(0u, 2u))
+    {
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+        ASSERT_TRUE(exchange.replay_journal(wallet));
+        ASSERT_EQ(exchange.pool_stats().used, 0);
+
+        {
+            SQLite::Statement statement(test_db, "SELECT COUNT(*) FROM requests");
+            ASSERT_TRUE(statement.executeStep());
+            ASSERT_EQ(statement.getColumn(0).getInt64(), 0);
+        }
+
+        // Events are applied only once, however many times the journal is replayed
+        std::array<std::pair<int64_t, int64_t>, 3> const balances{{{(63 * 20 + 64 * 10) * 100, -30 * 100},
+                                                                   {-63 * 20 * 100, 20 * 100},
+                                                                   {-64 * 10 * 100, 10 * 100}}};
+
+        for (uint32_t const i : std::views::iota(1u, 4u))
+        {
+            auto const wallets = wallet.wallets(i).value();
+
+            auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                           [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+            auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                           [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+            ASSERT_EQ(RUB_wallet->amount, balances[i - 1].first);
+            ASSERT_EQ(USD_wallet->amount, balances[i - 1].second);
+        }
+    }
+}
+
+TEST(Exchange, JournalMissingWallets_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    for (auto const table : {"requests", "wallets", "transactions", "balances", "journals"})
+    {
+        test_db.exec(std::string("DROP TABLE IF EXISTS ") + table);
+    }
+
+    // User (id: 2) has no wallets
+    modules::Wallet wallet(test_db, std::nullopt);
+    uint64_t new_wallet_id;
+    ASSERT_TRUE(wallet.create_wallet(1, "RUB", new_wallet_id));
+    ASSERT_TRUE(wallet.create_wallet(1, "USD", new_wallet_id));
+
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+
+    uint64_t request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+    ASSERT_FALSE(exchange.submit_order(wallet, 2, USD_RUB, 2000, 6300, modules::RequestType::Buy, request_id));
+
+    // A request accepted without the check is stopped before its fill is journaled
+    ASSERT_TRUE(exchange.make_request(2, USD_RUB, 2000, 6300, modules::RequestType::Buy));
+    ASSERT_FALSE(exchange.process_requests(wallet));
+    ASSERT_TRUE(exchange.take_journal_events().empty());
+
+    // The events after it still reach the database
+    ASSERT_TRUE(exchange.cancel_request(1, 1));
+    ASSERT_TRUE(exchange.commit_journal(wallet));
+
+    SQLite::Statement statement(test_db, "SELECT user_id FROM requests");
+    ASSERT_TRUE(statement.executeStep());
+    ASSERT_EQ(statement.getColumn(0).getInt64(), 2);
+    ASSERT_FALSE(statement.executeStep());
+
+    std::filesystem::remove("test_journal.bin");
+}
+
+TEST(Exchange, JournalPowerLoss_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+
+    // Database files as they were on disk at the last sync, the commits after it are lost with the power
+    static constexpr std::array<std::string_view, 2> database_files{"test.db", "test.db-wal"};
+
+    {
+        SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        for (auto const table : {"requests", "wallets", "transactions", "balances", "journals"})
+        {
+            test_db.exec(std::string("DROP TABLE IF EXISTS ") + table);
+        }
+
+        modules::Wallet wallet(test_db, std::nullopt);
+        for (uint32_t const i : std::views::iota(1u, 3u))
+        {
+            uint64_t new_wallet_id;
+            ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+            ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+        }
+
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+
+        uint64_t request_id;
+        ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+        ASSERT_TRUE(exchange.commit_journal(wallet));
+
+        for (auto const file : database_files)
+        {
+            std::filesystem::copy_file(file, "lost_" + std::string(file),
+                                       std::filesystem::copy_options::overwrite_existing);
+        }
+
+        // The request row and the fill are committed to the database, but only the journal is synced
+        ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 2000, 6300, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.commit_journal(wallet));
+    }
+
+    std::filesystem::remove("test.db-shm");
+    for (auto const file : database_files)
+    {
+        std::filesystem::rename("lost_" + std::string(file), file);
+    }
+
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    modules::Wallet wallet(test_db, std::nullopt);
+    {
+        SQLite::Statement statement(test_db, "SELECT COUNT(*) FROM requests");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
+    }
+
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+    ASSERT_TRUE(exchange.replay_journal(wallet));
+
+    {
+        SQLite::Statement statement(test_db, "SELECT id, amount FROM requests ORDER BY id");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 30 * 100);
+        ASSERT_FALSE(statement.executeStep());
+    }
+
+    std::array<std::pair<int64_t, int64_t>, 2> const balances{{{63 * 20 * 100, -20 * 100},
+                                                               {-63 * 20 * 100, 20 * 100}}};
+    for (uint32_t const i : std::views::iota(1u, 3u))
+    {
+        auto const wallets = wallet.wallets(i).value();
+
+        auto RUB_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("RUB") == 0; });
+
+        auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                       [&](auto const& element) { return element.currency.compare("USD") == 0; });
+
+        ASSERT_EQ(RUB_wallet->amount, balances[i - 1].first);
+        ASSERT_EQ(USD_wallet->amount, balances[i - 1].second);
+    }
+
+    // The replayed request keeps its id, so new requests are numbered after it
+    uint64_t request_id;
+    ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 1000, 6100, modules::RequestType::Buy, request_id));
+    ASSERT_EQ(request_id, 3);
+
+    std::filesystem::remove("test_journal.bin");
+}
+
+TEST(Exchange, CrashConsistency_Test)
+{
+    struct ScenarioOrder
+    {
+        uint64_t user_id;
+        int64_t amount;
+        int64_t price;
+        modules::RequestType request_type;
+    };
+
+    // Three fills: one filling both sides, one filling the buyer only and one filling the seller only
+    constexpr std::array<ScenarioOrder, 5> orders{{{1, 5000, 6200, modules::RequestType::Sell},
+                                                   {2, 3000, 6250, modules::RequestType::Sell},
+                                                   {3, 6000, 6300, modules::RequestType::Buy},
+                                                   {1, 1000, 6100, modules::RequestType::Buy},
+                                                   {3, 1500, 6250, modules::RequestType::Buy}}};
+
+    // Files a crash leaves behind, copied aside at the crash point and put back for the restart. A power loss only
+    // takes the database writes SQLite had not synced, the journal keeps everything it synced before answering
+    static constexpr std::array<std::string_view, 5> crash_files{"test.db", "test.db-wal", "test.db-journal",
+                                                          "test_journal.bin", "test_journal.snapshot"};
+
+    enum class Fault
+    {
+        Failure,
+        Crash,
+        PowerLoss
+    };
+
+    static auto const lost_files = [](Fault const fault) -> std::span<std::string_view const> {
+        return fault == Fault::PowerLoss ? std::span(crash_files).first(3) : std::span(crash_files);
+    };
+
+    // Orders go straight to an exchange, with or without the journal, or through an engine whose writer applies
+    // the fills on a connection of its own
+    enum class Path
+    {
+        Unjournaled,
+        Journaled,
+        Writer
+    };
+
+    // Counts the writes of the run through triggers, the one it reaches fails or is where the process dies.
+    // Connections only write one at a time, so the engine and its writer share it safely
+    struct FaultPoint
+    {
+        int64_t countdown;
+        Fault fault;
+        bool reached;
+    };
+    static FaultPoint point{};
+
+    static auto const on_write = [](sqlite3_context* context, int, sqlite3_value**) {
+        bool const reached = --point.countdown == 0;
+        if (reached && point.fault != Fault::Failure)
+        {
+            for (auto const file : lost_files(point.fault))
+            {
+                if (std::filesystem::exists(file))
+                {
+                    std::filesystem::copy_file(file, "crash_" + std::string(file),
+                                               std::filesystem::copy_options::overwrite_existing);
+                }
+            }
+        }
+        point.reached = point.reached || reached;
+        sqlite3_result_int(context, reached && point.fault == Fault::Failure);
+    };
+
+    // The writer opens its connection itself, so every connection gets the function as it is opened
+    static auto const register_on_write = [](sqlite3* database, char const**, sqlite3_api_routines const*) {
+        return sqlite3_create_function_v2(database, "on_write", 0, SQLITE_UTF8, nullptr, on_write, nullptr, nullptr,
+                                          nullptr);
+    };
+    auto const entry_point = reinterpret_cast<void (*)()>(+register_on_write);
+    ASSERT_EQ(sqlite3_auto_extension(entry_point), SQLITE_OK);
+
+    // Triggers are part of the schema to be seen by every connection, and of the files a crash leaves behind
+    static constexpr std::array<std::pair<std::string_view, std::string_view>, 8> fault_triggers{
+        {{"requests", "INSERT"},
+         {"requests", "UPDATE"},
+         {"requests", "DELETE"},
+         {"transactions", "INSERT"},
+         {"balances", "INSERT"},
+         {"balances", "UPDATE"},
+         {"journals", "INSERT"},
+         {"journals", "UPDATE"}}};
+
+    auto const create_triggers = [](SQLite::Database& database, bool const journaled) {
+        for (auto const& [table, operation] : fault_triggers)
+        {
+            if (journaled || table != "journals")
+            {
+                database.exec(fmt::format("CREATE TRIGGER fault_{0}_{1} BEFORE {1} ON {0} BEGIN SELECT "
+                                          "RAISE(ABORT, 'Injected fault') WHERE on_write(); END",
+                                          table, operation));
+            }
+        }
+    };
+
+    auto const drop_triggers = [](SQLite::Database& database) {
+        for (auto const& [table, operation] : fault_triggers)
+        {
+            database.exec(fmt::format("DROP TRIGGER IF EXISTS fault_{}_{}", table, operation));
+        }
+    };
+
+    auto const count = [](SQLite::Database& database, std::string const& query, int64_t const value) {
+        SQLite::Statement statement(database, query);
+        statement.bind(1, value);
+        return statement.executeStep() ? statement.getColumn(0).getInt64() : int64_t(0);
+    };
+
+    auto const accepted = [&](SQLite::Database& database) {
+        return count(database, "SELECT seq FROM sqlite_sequence WHERE name = 'requests' AND ?", 1);
+    };
+
+    // Every accepted request is one of the scenario orders, in order. Whatever was filled of them moved between
+    // wallets as a whole, and every balance matches the ledger
+    auto const verify = [&](SQLite::Database& database) {
+        int64_t const accepted_requests = accepted(database);
+        ASSERT_LE(accepted_requests, static_cast<int64_t>(orders.size()));
+
+        std::map<uint64_t, int64_t> USD_amounts;
+        int64_t bought = 0;
+        int64_t sold = 0;
+        for (int64_t const request_id : std::views::iota(int64_t{1}, accepted_requests + 1))
+        {
+            auto const& order = orders[request_id - 1];
+            int64_t const remaining = count(database, "SELECT amount FROM requests WHERE id = ?", request_id);
+            ASSERT_GE(remaining, 0);
+            ASSERT_LE(remaining, order.amount);
+
+            int64_t const filled = order.amount - remaining;
+            bool const is_buy = order.request_type == modules::RequestType::Buy;
+            USD_amounts[order.user_id] += is_buy ? filled : -filled;
+            (is_buy ? bought : sold) += filled;
+        }
+        ASSERT_EQ(bought, sold);
+
+        std::map<std::string, int64_t> totals;
+        SQLite::Statement statement(database, "SELECT wallets.user_id, wallets.currency, COALESCE(balances.amount, "
+                                              "0), (SELECT COALESCE(SUM(CASE transaction_type WHEN 1 THEN amount "
+                                              "ELSE -amount END), 0) FROM transactions WHERE wallet_id = "
+                                              "wallets.id) FROM wallets LEFT JOIN balances ON balances.wallet_id = "
+                                              "wallets.id");
+        while (statement.executeStep())
+        {
+            uint64_t const user_id = statement.getColumn(0).getInt64();
+            std::string const currency = statement.getColumn(1).getString();
+            int64_t const balance = statement.getColumn(2).getInt64();
+            ASSERT_EQ(balance, statement.getColumn(3).getInt64());
+
+            totals[currency] += balance;
+            if (currency == "USD")
+            {
+                ASSERT_EQ(balance, USD_amounts[user_id]);
+            }
+        }
+        ASSERT_EQ(totals["USD"], 0);
+        ASSERT_EQ(totals["RUB"], 0);
+    };
+
+    for (auto const path : {Path::Unjournaled, Path::Journaled, Path::Writer})
+    {
+        bool const journaled = path != Path::Unjournaled;
+        for (auto const fault : {Fault::Failure, Fault::Crash, Fault::PowerLoss})
+        {
+            // Without the journal a power loss is only a crash
+            if (!journaled && fault == Fault::PowerLoss)
+            {
+                continue;
+            }
+
+            for (int64_t write = 1;; ++write)
+            {
+                ASSERT_LT(write, 1000);
+
+                for (auto const file : crash_files)
+                {
+                    std::filesystem::remove("crash_" + std::string(file));
+                }
+                std::filesystem::remove("test_journal.bin");
+                std::filesystem::remove("test_journal.snapshot");
+
+                {
+                    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+                    for (auto const table : {"requests", "wallets", "transactions", "balances", "journals"})
+                    {
+                        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+                    }
+
+                    modules::Wallet wallet(test_db, std::nullopt);
+                    for (uint32_t const i : std::views::iota(1u, 4u))
+                    {
+                        uint64_t new_wallet_id;
+                        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+                        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+                    }
+                }
+
+                point = FaultPoint{.countdown = write, .fault = fault, .reached = false};
+                if (path == Path::Writer)
+                {
+                    // Responses wait for the writer, so each order is matched against every fill before it
+                    modules::MatchingEngine engine(
+                        modules::SQLiteBackend(
+                            modules::StorageSettings{.path = "test.db", .durability = modules::Durability::Database},
+                            std::nullopt),
+                        *core::find_instrument("USD/RUB"), std::nullopt, "test_journal.bin");
+                    {
+                        SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE);
+                        create_triggers(test_db, journaled);
+                    }
+                    engine.start();
+
+                    for (auto const& order : orders)
+                    {
+                        std::promise<bool> promise;
+                        engine.submit_order(order.user_id, order.amount, order.price, order.request_type,
+                                            [&promise](bool const successful, uint64_t const request_id) {
+                                                promise.set_value(successful);
+                                            });
+                        if (!promise.get_future().get())
+                        {
+                            break;
+                        }
+                    }
+                }
+                else
+                {
+                    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+                    modules::Wallet wallet(test_db, std::nullopt);
+                    std::optional<modules::Journal> journal;
+                    if (journaled)
+                    {
+                        journal.emplace("test_journal.bin", std::nullopt);
+                    }
+                    modules::Exchange exchange(test_db, std::nullopt, core::instruments,
+                                               journal ? &journal.value() : nullptr);
+                    create_triggers(test_db, journaled);
+
+                    // The run stops at the first call that fails, as a restart would follow it
+                    for (auto const& order : orders)
+                    {
+                        uint64_t request_id;
+                        if (!exchange.submit_order(wallet, order.user_id, USD_RUB, order.amount, order.price,
+                                                   order.request_type, request_id) ||
+                            !exchange.commit_journal(wallet))
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                // Every write of the scenario has been failed or crashed at once
+                if (!point.reached)
+                {
+                    ASSERT_GT(write, 1);
+                    break;
+                }
+
+                if (fault != Fault::Failure)
+                {
+                    std::filesystem::remove("test.db-shm");
+                    for (auto const file : lost_files(fault))
+                    {
+                        std::filesystem::remove(file);
+                        if (std::filesystem::exists("crash_" + std::string(file)))
+                        {
+                            std::filesystem::rename("crash_" + std::string(file), file);
+                        }
+                    }
+                }
+
+                // The restart recovers from what is on disk, and finishes the matching the failure interrupted
+                SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+                drop_triggers(test_db);
+                modules::Wallet wallet(test_db, std::nullopt);
+                std::optional<modules::Journal> journal;
+                if (journaled)
+                {
+                    journal.emplace("test_journal.bin", std::nullopt);
+                }
+                modules::Exchange exchange(test_db, std::nullopt, core::instruments,
+                                           journal ? &journal.value() : nullptr);
+                ASSERT_TRUE(exchange.replay_journal(wallet, "test_journal.snapshot"));
+                verify(test_db);
+
+                // Nothing was lost with the power but what the journal brings back
+                if (fault == Fault::PowerLoss)
+                {
+                    ASSERT_EQ(accepted(test_db), static_cast<int64_t>(orders.size()));
+                }
+
+                ASSERT_TRUE(exchange.process_requests(wallet));
+                ASSERT_TRUE(exchange.commit_journal(wallet));
+                verify(test_db);
+            }
+        }
+    }
+
+    sqlite3_cancel_auto_extension(entry_point);
+    std::filesystem::remove("test_journal.bin");
+    std::filesystem::remove("test_journal.snapshot");
+}
+
+TEST(Exchange, Snapshot_Test)
+{
+    std::filesystem::remove("test_journal.bin");
+    std::filesystem::remove("test.snapshot");
+
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"requests", "wallets", "transactions", "journals"})
+    {
+        test_db.exec(std::string("DROP TABLE IF EXISTS ") + table);
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 5u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    {
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+        ASSERT_TRUE(exchange.replay_journal(wallet, "test.snapshot"));
+
+        uint64_t request_id;
+        ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+        ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 3000, 6200, modules::RequestType::Sell, request_id));
+        ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 2000, 6000, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.submit_order(wallet, 4, USD_RUB, 1000, 6300, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.commit_journal(wallet));
+        ASSERT_TRUE(exchange.save_snapshot("test.snapshot"));
+
+        // Events after the snapshot are only in the journal
+        ASSERT_TRUE(exchange.submit_order(wallet, 4, USD_RUB, 4500, 6200, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.cancel_request(3, 3));
+        ASSERT_TRUE(exchange.submit_order(wallet, 3, USD_RUB, 1500, 6100, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(journal.commit());
+    }
+
+    // A request inserted right before the process stopped, before it was journaled
+    test_db.exec("INSERT INTO requests (user_id, currency, amount, price, request_type) "
+                 "VALUES (1, 'USD/RUB', 700, 6500, 1)");
+
+    {
+        auto const snapshot = modules::Snapshot::load("test.snapshot");
+        ASSERT_TRUE(snapshot.has_value());
+        ASSERT_EQ(snapshot->last_request_id, 4);
+        ASSERT_EQ(snapshot->orders.size(), 3);
+    }
+
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+    ASSERT_TRUE(exchange.replay_journal(wallet, "test.snapshot"));
+    ASSERT_TRUE(exchange.save_snapshot("test_restored.snapshot"));
+
+    // The restored book holds exactly the requests of the database
+    auto const restored = modules::Snapshot::load("test_restored.snapshot");
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(restored->sequence, journal.committed_sequence());
+    ASSERT_EQ(restored->last_request_id, 7);
+
+    std::vector<std::tuple<uint64_t, uint64_t, int64_t, int64_t>> orders;
+    for (auto const& [instrument, order] : restored->orders)
+    {
+        orders.emplace_back(order.request_id, order.user_id, order.amount, order.price);
+    }
+    std::sort(orders.begin(), orders.end());
+
+    std::vector<std::tuple<uint64_t, uint64_t, int64_t, int64_t>> requests;
+    {
+        SQLite::Statement statement(test_db, "SELECT id, user_id, amount, price FROM requests ORDER BY id");
+        while (statement.executeStep())
+        {
+            requests.emplace_back(statement.getColumn(0).getInt64(), statement.getColumn(1).getInt64(),
+                                  statement.getColumn(2).getInt64(), statement.getColumn(3).getInt64());
+        }
+    }
+
+    ASSERT_EQ(orders, requests);
+    ASSERT_EQ(orders.size(), 3);
+    ASSERT_EQ(std::get<0>(orders[0]), 2);
+    ASSERT_EQ(std::get<2>(orders[0]), 25 * 100);
+    ASSERT_EQ(std::get<0>(orders[1]), 6);
+    ASSERT_EQ(std::get<0>(orders[2]), 7);
+
+    std::filesystem::remove("test_restored.snapshot");
+}
+
+TEST(Exchange, StatementCache_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    {
+        SQLite::Statement statement(test_db, "DROP TABLE IF EXISTS transactions");
+        ASSERT_EQ(statement.exec(), SQLite::OK);
+    }
+
+    modules::StatementCache statements(test_db);
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    uint64_t wallet_id;
+    ASSERT_TRUE(wallet.create_wallet(1, "RUB", wallet_id));
+    for (uint32_t const i : std::views::iota(0u, 10u))
+    {
+        ASSERT_TRUE(wallet.make_transaction(wallet_id, 100, modules::WalletTransactionType::Deposit, "Deposit"));
+    }
+
+    // Every query is compiled once, however many times it runs: the wallet insert, and the savepoint,
+    // ledger insert, balance update and release of every transaction
+    auto stats = wallet.statement_stats();
+    ASSERT_EQ(stats.prepares, 5);
+    ASSERT_EQ(stats.hits, 9 * 4);
+    ASSERT_EQ(stats.size, 5);
+
+    // A statement is handed back reset and unbound, and a nested use of the same query gets its own
+    {
+        auto outer = statements.prepare("SELECT amount FROM transactions WHERE wallet_id = ?");
+        outer->bind(1, static_cast<int64_t>(wallet_id));
+        ASSERT_TRUE(outer->executeStep());
+
+        auto inner = statements.prepare("SELECT amount FROM transactions WHERE wallet_id = ?");
+        inner->bind(1, static_cast<int64_t>(wallet_id));
+        ASSERT_TRUE(inner->executeStep());
+        ASSERT_EQ(inner->getColumn(0).getInt64(), 100);
+    }
+
+    {
+        auto statement = statements.prepare("SELECT amount FROM transactions WHERE wallet_id = ?");
+        ASSERT_FALSE(statement->executeStep());
+    }
+
+    stats = statements.stats();
+    ASSERT_EQ(stats.prepares, 2);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.size, 1);
+}
+
+TEST(Exchange, Storage_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    modules::StorageSettings const storage{.path = "test.db", .mmap_size = 1024 * 1024, .cache_size = -2048};
+    storage.apply(test_db);
+    ASSERT_EQ(modules::StorageSettings::describe(test_db),
+              "journal_mode wal, synchronous 1, mmap_size 1048576, cache_size -2048, wal_autocheckpoint 0");
+
+    ASSERT_THROW((modules::StorageSettings{.journal_mode = "WAL; DROP TABLE requests"}.apply(test_db)),
+                 std::invalid_argument);
+    ASSERT_THROW((modules::StorageSettings{.synchronous = "SOMETIMES"}.apply(test_db)), std::invalid_argument);
+
+    // Accounts and wallets are not journaled, so their connection syncs every commit but keeps a stronger level
+    storage.apply_unjournaled(test_db);
+    ASSERT_NE(modules::StorageSettings::describe(test_db).find("synchronous 2,"), std::string::npos);
+    modules::StorageSettings{.synchronous = "extra"}.apply_unjournaled(test_db);
+    ASSERT_NE(modules::StorageSettings::describe(test_db).find("synchronous 3,"), std::string::npos);
+    storage.apply(test_db);
+
+    // Commits only append to the WAL until the checkpointer copies it back
+    test_db.exec("DROP TABLE IF EXISTS checkpoints");
+    test_db.exec("CREATE TABLE checkpoints (id INTEGER PRIMARY KEY)");
+    test_db.exec("INSERT INTO checkpoints DEFAULT VALUES");
+    ASSERT_GT(std::filesystem::file_size("test.db-wal"), 0);
+
+    modules::Checkpointer checkpointer(modules::SQLiteBackend(storage, std::nullopt), std::nullopt);
+    ASSERT_TRUE(checkpointer.checkpoint(true));
+    ASSERT_EQ(std::filesystem::file_size("test.db-wal"), 0);
+
+    test_db.exec("DROP TABLE checkpoints");
+}
+
+TEST(Exchange, StorageBackend_Test)
+{
+    std::filesystem::remove("test_image.db");
+    modules::StorageSettings const settings{.backend = modules::BackendType::Memory, .path = "test_image.db"};
+
+    // Connections of a memory backend share its tables, other backends and the disk never see them
+    {
+        auto const storage = modules::StorageBackend::create(settings, std::nullopt);
+        ASSERT_EQ(storage->name(), "memory");
+        ASSERT_FALSE(storage->persistent());
+
+        auto first_db = storage->open();
+        auto second_db = storage->open();
+        first_db.exec("CREATE TABLE backends (name TEXT)");
+        first_db.exec("INSERT INTO backends VALUES ('memory')");
+        ASSERT_TRUE(second_db.tableExists("backends"));
+
+        auto const other_storage = modules::StorageBackend::create(settings, std::nullopt);
+        auto other_db = other_storage->open();
+        ASSERT_FALSE(other_db.tableExists("backends"));
+
+        ASSERT_TRUE(storage->flush());
+        ASSERT_FALSE(std::filesystem::exists("test_image.db"));
+    }
+
+    // A journal backend writes its tables out on flush and starts from them again
+    {
+        auto storage = modules::StorageBackend::create(
+            modules::StorageSettings{.backend = modules::BackendType::Journal, .path = "test_image.db"},
+            std::nullopt);
+        ASSERT_EQ(storage->name(), "journal");
+
+        auto test_db = storage->open();
+        modules::Wallet wallet(test_db, std::nullopt);
+
+        uint64_t RUB_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(1, "RUB", RUB_wallet_id));
+        ASSERT_TRUE(wallet.make_transaction(RUB_wallet_id, 10000, modules::WalletTransactionType::Deposit, "Deposit"));
+
+        ASSERT_TRUE(storage->flush());
+        ASSERT_TRUE(std::filesystem::exists("test_image.db"));
+    }
+    {
+        auto storage = modules::StorageBackend::create(
+            modules::StorageSettings{.backend = modules::BackendType::Journal, .path = "test_image.db"},
+            std::nullopt);
+
+        auto test_db = storage->open();
+        modules::Wallet wallet(test_db, std::nullopt);
+        auto const wallets = wallet.wallets(1);
+        ASSERT_TRUE(wallets);
+        ASSERT_EQ(wallets->size(), 1);
+        ASSERT_EQ(wallets->front().currency, "RUB");
+        ASSERT_EQ(wallets->front().amount, 10000);
+    }
+
+    // Orders since the image are replayed from the journal when the process dies without a flush
+    std::filesystem::remove("test_image.db");
+    std::filesystem::remove("test_journal.bin");
+    modules::StorageSettings const journal_settings{.backend = modules::BackendType::Journal,
+                                                    .path = "test_image.db"};
+    {
+        auto storage = modules::StorageBackend::create(journal_settings, std::nullopt);
+        ASSERT_TRUE(storage->journaled());
+
+        auto test_db = storage->open();
+        modules::Wallet wallet(test_db, std::nullopt);
+        for (uint32_t const i : std::views::iota(1u, 3u))
+        {
+            uint64_t new_wallet_id;
+            ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+            ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+        }
+
+        // As after a registration
+        ASSERT_TRUE(storage->flush());
+
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+
+        uint64_t request_id;
+        ASSERT_TRUE(exchange.submit_order(wallet, 1, USD_RUB, 5000, 6200, modules::RequestType::Sell, request_id));
+        ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 2000, 6300, modules::RequestType::Buy, request_id));
+        ASSERT_TRUE(exchange.commit_journal(wallet));
+    }
+    {
+        auto storage = modules::StorageBackend::create(journal_settings, std::nullopt);
+        auto test_db = storage->open();
+        modules::Wallet wallet(test_db, std::nullopt);
+        modules::Journal journal("test_journal.bin", std::nullopt);
+        modules::Exchange exchange(test_db, std::nullopt, core::instruments, &journal);
+        ASSERT_TRUE(exchange.replay_journal(wallet));
+
+        SQLite::Statement statement(test_db, "SELECT id, amount FROM requests");
+        ASSERT_TRUE(statement.executeStep());
+        ASSERT_EQ(statement.getColumn(0).getInt64(), 1);
+        ASSERT_EQ(statement.getColumn(1).getInt64(), 30 * 100);
+        ASSERT_FALSE(statement.executeStep());
+
+        for (auto const& [user_id, USD_amount] : {std::pair{1, -20 * 100}, std::pair{2, 20 * 100}})
+        {
+            auto const wallets = wallet.wallets(user_id).value();
+            auto USD_wallet = std::find_if(wallets.begin(), wallets.end(),
+                                           [&](auto const& element) { return element.currency.compare("USD") == 0; });
+            ASSERT_EQ(USD_wallet->amount, USD_amount);
+        }
+
+        uint64_t request_id;
+        ASSERT_TRUE(exchange.submit_order(wallet, 2, USD_RUB, 1000, 6100, modules::RequestType::Buy, request_id));
+        ASSERT_EQ(request_id, 3);
+    }
+
+    // A memory backend has nothing to replay into, so engines keep no journal on it
+    ASSERT_FALSE(modules::StorageBackend::create(settings, std::nullopt)->journaled());
+
+    std::filesystem::remove("test_image.db");
+    std::filesystem::remove("test_journal.bin");
+}
+
+TEST(Exchange, SchemaMigrations_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"requests", "wallets", "transactions", "users", "schema_versions"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    modules::LoginSystem login_system(test_db, std::nullopt);
+    modules::Wallet wallet(test_db, std::nullopt);
+    modules::Exchange exchange(test_db, std::nullopt);
+
+    auto const query_plan = [&test_db](std::string_view const query) {
+        SQLite::Statement statement(test_db, fmt::format("EXPLAIN QUERY PLAN {}", query));
+        std::string plan;
+        while (statement.executeStep())
+        {
+            plan += statement.getColumn(3).getString();
+        }
+        return plan;
+    };
+
+    // Every hot query is answered from an index alone
+    ASSERT_NE(query_plan("SELECT id, user_id, amount, price, request_type FROM requests "
+                         "WHERE currency = 'USD/RUB' AND id > 0 ORDER BY id ASC")
+                  .find("USING COVERING INDEX requests_currency"),
+              std::string::npos);
+    ASSERT_NE(query_plan("SELECT SUM(amount) FROM transactions WHERE wallet_id = 1 and transaction_type = 1")
+                  .find("USING COVERING INDEX transactions_wallet"),
+              std::string::npos);
+    ASSERT_NE(query_plan("SELECT id, currency FROM wallets WHERE user_id = 1").find("USING COVERING INDEX wallets_user"),
+              std::string::npos);
+    ASSERT_NE(query_plan("SELECT id FROM users WHERE user_name = 'user' and v = 'v'")
+                  .find("USING COVERING INDEX users_user_name"),
+              std::string::npos);
+
+    // Applied migrations are skipped, later ones run on top of them
+    std::array<modules::Migration, 2> const migrations{
+        {{.version = 1, .statement = "CREATE TABLE migrations (id INTEGER PRIMARY KEY)"},
+         {.version = 2, .statement = "CREATE INDEX migrations_id ON migrations (id)"}}};
+    test_db.exec("DROP TABLE IF EXISTS migrations");
+    ASSERT_EQ(modules::migrate(test_db, "test", std::span(migrations).first(1)), 1);
+    ASSERT_EQ(modules::migrate(test_db, "test", migrations), 2);
+    ASSERT_EQ(modules::migrate(test_db, "test", migrations), 2);
+
+    {
+        SQLite::Statement statement(test_db, "SELECT component, version FROM schema_versions ORDER BY component");
+        std::vector<std::pair<std::string, uint32_t>> versions;
+        while (statement.executeStep())
+        {
+            versions.emplace_back(statement.getColumn(0).getString(), statement.getColumn(1).getUInt());
+        }
+        ASSERT_EQ(versions, (std::vector<std::pair<std::string, uint32_t>>{
+                                {"exchange", 1}, {"login", 1}, {"test", 2}, {"wallet", 2}}));
+    }
+
+    test_db.exec("DROP TABLE migrations");
+}
+
+TEST(Exchange, Balances_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"wallets", "transactions", "balances"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    auto const balances = [](modules::Wallet& wallet, uint64_t const user_id) {
+        auto const wallet_infos = wallet.wallets(user_id);
+        std::vector<std::pair<std::string, int64_t>> balances;
+        for (auto const& wallet_info : wallet_infos.value())
+        {
+            balances.emplace_back(wallet_info.currency, wallet_info.amount);
+        }
+        std::sort(balances.begin(), balances.end());
+        return balances;
+    };
+
+    {
+        modules::Wallet wallet(test_db, std::nullopt);
+
+        uint64_t RUB_wallet_id;
+        uint64_t USD_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(1, "RUB", RUB_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(1, "USD", USD_wallet_id));
+        ASSERT_EQ(balances(wallet, 1), (std::vector<std::pair<std::string, int64_t>>{{"RUB", 0}, {"USD", 0}}));
+
+        ASSERT_TRUE(wallet.make_transaction(RUB_wallet_id, 10000, modules::WalletTransactionType::Deposit, "Deposit"));
+        ASSERT_TRUE(wallet.make_transaction(RUB_wallet_id, 2500, modules::WalletTransactionType::Withdraw, "Withdraw"));
+        ASSERT_TRUE(wallet.make_transaction(USD_wallet_id, 700, modules::WalletTransactionType::Deposit, "Deposit"));
+
+        // The balance moves with the ledger row, and rolls back with it
+        {
+            SQLite::Transaction transaction(test_db);
+            ASSERT_TRUE(
+                wallet.make_transaction(USD_wallet_id, 300, modules::WalletTransactionType::Withdraw, "Withdraw"));
+        }
+        ASSERT_EQ(balances(wallet, 1), (std::vector<std::pair<std::string, int64_t>>{{"RUB", 7500}, {"USD", 700}}));
+    }
+
+    // A database without balances gets them from the ledger
+    test_db.exec("DROP TABLE balances");
+    modules::Wallet wallet(test_db, std::nullopt);
+    ASSERT_EQ(balances(wallet, 1), (std::vector<std::pair<std::string, int64_t>>{{"RUB", 7500}, {"USD", 700}}));
+}
+
+TEST(Exchange, EventWriter_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"wallets", "transactions", "balances"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 3u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    auto const requests = [&test_db]() {
+        std::vector<std::pair<int64_t, int64_t>> requests;
+        SQLite::Statement statement(test_db, "SELECT user_id, amount FROM requests ORDER BY id");
+        while (statement.executeStep())
+        {
+            requests.emplace_back(statement.getColumn(0).getInt64(), statement.getColumn(1).getInt64());
+        }
+        return requests;
+    };
+
+    for (auto const durability :
+         {modules::Durability::Database, modules::Durability::Journal, modules::Durability::Memory})
+    {
+        std::filesystem::remove("test_journal.bin");
+        std::filesystem::remove("test_journal.snapshot");
+        for (auto const table : {"requests", "journals"})
+        {
+            test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+        }
+
+        {
+            modules::MatchingEngine engine(
+                modules::SQLiteBackend(modules::StorageSettings{.path = "test.db", .durability = durability},
+                                       std::nullopt),
+                *core::find_instrument("USD/RUB"), std::nullopt, "test_journal.bin");
+            engine.start();
+
+            std::vector<std::future<bool>> results;
+            for (auto const& [user_id, amount, price, request_type] :
+                 {std::tuple(1, 3000, 6200, modules::RequestType::Sell),
+                  std::tuple(2, 5000, 6300, modules::RequestType::Buy)})
+            {
+                auto promise = std::make_shared<std::promise<bool>>();
+                results.emplace_back(promise->get_future());
+                engine.submit_order(user_id, amount, price, request_type,
+                                    [promise](bool const successful, uint64_t const request_id) {
+                                        promise->set_value(successful);
+                                    });
+            }
+
+            for (auto& result : results)
+            {
+                ASSERT_TRUE(result.get());
+            }
+
+            // Only the strictest policy waits for the database before responding
+            if (durability == modules::Durability::Database)
+            {
+                ASSERT_EQ(requests(), (std::vector<std::pair<int64_t, int64_t>>{{2, 20 * 100}}));
+            }
+        }
+
+        // Whatever was acknowledged reaches the database by the time the engine has stopped
+        ASSERT_EQ(requests(), (std::vector<std::pair<int64_t, int64_t>>{{2, 20 * 100}}));
+    }
+
+    std::filesystem::remove("test_journal.snapshot");
+
+    // A fill the database cannot take yet is retried, and answered only once it is applied
+    std::filesystem::remove("test_journal.bin");
+    for (auto const table : {"requests", "journals"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    modules::SQLiteBackend const storage(
+        modules::StorageSettings{.path = "test.db", .durability = modules::Durability::Database}, std::nullopt);
+    modules::Journal journal("test_journal.bin", std::nullopt);
+    modules::EventWriter writer(storage, journal, std::nullopt);
+    writer.start();
+
+    modules::JournalEvent const fill{.type = modules::JournalEventType::Fill,
+                                     .instrument = USD_RUB,
+                                     .request_type = modules::RequestType::Buy,
+                                     .request_id = 1,
+                                     .user_id = 1,
+                                     .amount = 1000,
+                                     .price = 6200,
+                                     .counter_request_id = 2,
+                                     .counter_user_id = 2,
+                                     .request_amount = 1000,
+                                     .counter_amount = 1000};
+    auto const committed = std::make_shared<std::promise<void>>();
+    writer.write({fill}, journal.append(fill), [committed]() { committed->set_value(); });
+
+    auto result = committed->get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::milliseconds(300)), std::future_status::timeout);
+
+    test_db.exec("INSERT INTO requests (id, user_id, currency, amount, price, request_type) VALUES "
+                 "(1, 1, 'USD/RUB', 1000, 6200, 0), (2, 2, 'USD/RUB', 1000, 6200, 1)");
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    ASSERT_TRUE(requests().empty());
+
+    writer.stop();
+    std::filesystem::remove("test_journal.bin");
+}
+
+TEST(Exchange, ExecutionReports_Test)
+{
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"wallets", "transactions", "balances"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    modules::Wallet wallet(test_db, std::nullopt);
+
+    for (uint32_t const i : std::views::iota(1u, 3u))
+    {
+        uint64_t new_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(i, "RUB", new_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(i, "USD", new_wallet_id));
+    }
+
+    using Report = std::tuple<uint64_t, uint64_t, modules::RequestType, int64_t, int64_t, int64_t>;
+
+    // Without a journal fills are reported once committed, with one once the policy considers them durable
+    for (auto const journal_path :
+         {std::optional<std::filesystem::path>(), std::optional<std::filesystem::path>("test_journal.bin")})
+    {
+        std::filesystem::remove("test_journal.bin");
+        std::filesystem::remove("test_journal.snapshot");
+        for (auto const table : {"requests", "journals"})
+        {
+            test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+        }
+
+        std::mutex mutex;
+        std::vector<Report> reports;
+        {
+            modules::MatchingEngine engine(
+                modules::SQLiteBackend(modules::StorageSettings{.path = "test.db"}, std::nullopt),
+                *core::find_instrument("USD/RUB"), std::nullopt, journal_path);
+            engine.on_execution = [&](modules::Execution const& execution) {
+                ASSERT_EQ(execution.instrument, USD_RUB);
+
+                std::lock_guard lock(mutex);
+                reports.emplace_back(execution.request_id, execution.user_id, execution.request_type,
+                                     execution.amount, execution.price, execution.remaining);
+            };
+            engine.start();
+
+            for (auto const& [user_id, amount, price, request_type] :
+                 {std::tuple(1, 3000, 6200, modules::RequestType::Sell),
+                  std::tuple(2, 5000, 6300, modules::RequestType::Buy),
+                  std::tuple(1, 1000, 6400, modules::RequestType::Sell)})
+            {
+                std::promise<bool> promise;
+                engine.submit_order(user_id, amount, price, request_type,
+                                    [&promise](bool const successful, uint64_t const request_id) {
+                                        promise.set_value(successful);
+                                    });
+                ASSERT_TRUE(promise.get_future().get());
+            }
+        }
+
+        // Both sides of the fill, the second sell does not cross
+        std::lock_guard lock(mutex);
+        ASSERT_EQ(reports, (std::vector<Report>{{2, 2, modules::RequestType::Buy, 3000, 6300, 2000},
+                                                {1, 1, modules::RequestType::Sell, 3000, 6300, 0}}));
+    }
+
+    std::filesystem::remove("test_journal.bin");
+    std::filesystem::remove("test_journal.snapshot");
+}
+
+TEST(Exchange, Framing_Test)
+{
+    std::string const large(5000, 'x');
+    std::vector<std::string> const messages{"{\"type\":1}", "", large, "{\"type\":2}"};
+
+    std::vector<uint8_t> stream;
+    for (auto const& message : messages)
+    {
+        auto const frame = core::frame(message);
+        ASSERT_EQ(frame.size(), core::frame_header_size + message.size());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    // However the stream is cut into reads, the same messages come out of it
+    for (size_t const read_size : {size_t{1}, size_t{3}, size_t{7}, size_t{4096}, stream.size()})
+    {
+        core::FrameReader reader;
+        std::vector<std::string> received;
+        for (size_t offset = 0; offset < stream.size(); offset += read_size)
+        {
+            size_t const size = std::min(read_size, stream.size() - offset);
+            auto const buffer = reader.prepare(size);
+            std::copy_n(stream.begin() + offset, size, buffer.begin());
+            reader.commit(size);
+
+            while (auto const message = reader.next())
+            {
+                received.emplace_back(message->begin(), message->end());
+            }
+        }
+        ASSERT_FALSE(reader.failed());
+        ASSERT_EQ(received, messages);
+    }
+
+    // A length over the limit cannot be skipped, so the stream is given up
+    core::FrameReader reader;
+    std::vector<uint8_t> header;
+    core::put_integer(header, core::max_frame_size + 1);
+    auto const buffer = reader.prepare(header.size());
+    std::copy(header.begin(), header.end(), buffer.begin());
+    reader.commit(header.size());
+    ASSERT_FALSE(reader.next());
+    ASSERT_TRUE(reader.failed());
+
+    // A message dumped straight into a buffer is framed like its text, after what the buffer already holds
+    nlohmann::json packet;
+    packet["type"] = 32;
+    packet["payload"]["wallets"] = std::vector<std::string>{"RUB", "USD"};
+
+    std::vector<uint8_t> framed{1, 2, 3};
+    core::frame(packet, framed);
+    auto expected = std::vector<uint8_t>{1, 2, 3};
+    auto const text = core::frame(packet.dump());
+    expected.insert(expected.end(), text.begin(), text.end());
+    ASSERT_EQ(framed, expected);
+}
+
+TEST(Exchange, BufferPool_Test)
+{
+    core::BufferPool pool(2, 1024);
+
+    // Released buffers come back empty with their capacity
+    auto buffer = pool.acquire();
+    ASSERT_EQ(buffer.capacity(), 0);
+    buffer.resize(512);
+    pool.release(std::move(buffer));
+    ASSERT_EQ(pool.size(), 1);
+
+    buffer = pool.acquire();
+    ASSERT_TRUE(buffer.empty());
+    ASSERT_GE(buffer.capacity(), 512);
+    ASSERT_EQ(pool.size(), 0);
+
+    // Buffers grown past the limit and buffers over the count are freed
+    std::vector<uint8_t> large(2048);
+    pool.release(std::move(large));
+    ASSERT_EQ(pool.size(), 0);
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        std::vector<uint8_t> small(16);
+        pool.release(std::move(small));
+    }
+    ASSERT_EQ(pool.size(), 2);
+
+    // An idle reader gives its storage back and takes a pooled one for the next read
+    core::FrameReader reader;
+    auto const frame = core::frame("{}");
+    auto const span = reader.prepare(frame.size());
+    std::copy(frame.begin(), frame.end(), span.begin());
+    reader.commit(frame.size() - 1);
+    ASSERT_FALSE(reader.next());
+    ASSERT_TRUE(reader.release().empty());
+
+    reader.commit(1);
+    ASSERT_TRUE(reader.next());
+    ASSERT_TRUE(reader.empty());
+    ASSERT_GT(reader.release().capacity(), 0);
+
+    reader.reset(pool.acquire());
+    ASSERT_GE(reader.prepare(8).size(), 8);
+}
+
+TEST(Exchange, Pipeline_Test)
+{
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::acceptor acceptor(io_context, {boost::asio::ip::address_v4::loopback(), 0});
+    core::BufferPool buffers;
+
+    struct PendingCancel
+    {
+        uint64_t request_id;
+        uint64_t correlation_id;
+        ResponseHandler on_response;
+    };
+
+    // Cancels are held until every one of them has arrived, then answered last to first. The responses are
+    // queued while the first of them is being written
+    constexpr size_t request_count = 8;
+    std::vector<PendingCancel> pending;
+    std::shared_ptr<Session> session;
+    acceptor.async_accept([&](boost::system::error_code const& error, boost::asio::ip::tcp::socket&& socket) {
+        ASSERT_FALSE(error);
+        session = std::make_shared<Session>(std::move(socket), 0, buffers);
+        session->on_message = [&](uint64_t const, std::span<uint8_t const> const buffer,
+                                  ResponseHandler const& on_response) {
+            auto const packet = nlohmann::json::parse(buffer.begin(), buffer.end());
+            pending.emplace_back(PendingCancel{.request_id = packet["payload"]["request_id"].get<uint64_t>(),
+                                               .correlation_id = packet["id"].get<uint64_t>(),
+                                               .on_response = on_response});
+            if (pending.size() < request_count)
+            {
+                return;
+            }
+
+            for (auto it = pending.rbegin(); it != pending.rend(); ++it)
+            {
+                nlohmann::json response;
+                response["error_code"] =
+                    it->request_id % 2 == 0 ? core::ErrorCode::Success : core::ErrorCode::RequestNotFound;
+                it->on_response(
+                    Response(core::RequestMessageType::CancelRequest, response).correlate(it->correlation_id));
+            }
+        };
+        session->start();
+    });
+    std::thread server([&]() { io_context.run(); });
+
+    boost::asio::io_context client_context;
+    boost::asio::ip::tcp::socket socket(client_context);
+    socket.connect(acceptor.local_endpoint());
+
+    // Each response lands in the packet its id names, not in the one sent at the same position
+    std::array<bool, request_count> cancelled;
+    Pipeline pipeline(socket);
+    for (size_t const i : std::views::iota(size_t{0}, request_count))
+    {
+        uint64_t const request_id = i + 1;
+        cancelled[i] = request_id % 2 != 0;
+        pipeline.submit(std::make_unique<packets::CancelRequestPacket>(USD_RUB, request_id, cancelled[i]));
+    }
+    ASSERT_TRUE(pipeline.complete());
+
+    for (size_t const i : std::views::iota(size_t{0}, request_count))
+    {
+        ASSERT_EQ(cancelled[i], (i + 1) % 2 == 0);
+    }
+
+    socket.close();
+    server.join();
+}
+
+TEST(Exchange, PipelineMismatch_Test)
+{
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::acceptor acceptor(io_context, {boost::asio::ip::address_v4::loopback(), 0});
+
+    // The server answers with an id no request was sent with, followed by the response that was asked for
+    std::thread server([&]() {
+        auto socket = acceptor.accept();
+
+        std::vector<uint8_t> header(core::frame_header_size);
+        boost::asio::read(socket, boost::asio::buffer(header));
+        size_t offset = 0;
+        std::vector<uint8_t> body(core::get_integer<uint32_t>(header, offset).value());
+        boost::asio::read(socket, boost::asio::buffer(body));
+
+        std::vector<uint8_t> responses;
+        for (uint64_t const id : {42, 0})
+        {
+            nlohmann::json response;
+            response["type"] = static_cast<uint16_t>(core::RequestMessageType::CancelRequest);
+            response["id"] = id;
+            response["payload"]["error_code"] = core::ErrorCode::Success;
+            core::frame(response, responses);
+        }
+        boost::system::error_code error;
+        boost::asio::write(socket, boost::asio::buffer(responses), error);
+    });
+
+    boost::asio::io_context client_context;
+    boost::asio::ip::tcp::socket socket(client_context);
+    socket.connect(acceptor.local_endpoint());
+
+    bool cancelled = false;
+    Pipeline pipeline(socket);
+    pipeline.submit(std::make_unique<packets::CancelRequestPacket>(USD_RUB, 1, cancelled));
+    ASSERT_FALSE(pipeline.complete());
+    ASSERT_FALSE(cancelled);
+    ASSERT_FALSE(socket.is_open());
+
+    server.join();
+}
+
+TEST(Exchange, SessionWriteLimit_Test)
+{
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::acceptor acceptor(io_context, {boost::asio::ip::address_v4::loopback(), 0});
+    core::BufferPool buffers;
+
+    // Every request is answered at once with far more than the client sends, so unread responses pile up
+    constexpr size_t request_count = 512;
+    std::string const filler(64 * 1024, 'x');
+    std::atomic<size_t> handled = 0;
+    std::shared_ptr<Session> session;
+    acceptor.async_accept([&](boost::system::error_code const& error, boost::asio::ip::tcp::socket&& socket) {
+        ASSERT_FALSE(error);
+        session = std::make_shared<Session>(std::move(socket), 0, buffers);
+        session->on_message = [&](uint64_t const, std::span<uint8_t const> const, ResponseHandler const& on_response) {
+            ++handled;
+            nlohmann::json response;
+            response["filler"] = filler;
+            on_response(Response(core::RequestMessageType::WalletList, response));
+        };
+        session->start();
+    });
+    std::thread server([&]() { io_context.run(); });
+
+    boost::asio::io_context client_context;
+    boost::asio::ip::tcp::socket socket(client_context);
+    socket.connect(acceptor.local_endpoint());
+
+    std::vector<uint8_t> requests;
+    for (size_t const i : std::views::iota(size_t{0}, request_count))
+    {
+        nlohmann::json request;
+        request["type"] = static_cast<uint16_t>(core::RequestMessageType::WalletList);
+        request["id"] = i;
+        core::frame(request, requests);
+    }
+    boost::asio::write(socket, boost::asio::buffer(requests));
+
+    // Requests stay unread while the client leaves the responses in the socket
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ASSERT_LT(handled, request_count);
+
+    for (size_t const i : std::views::iota(size_t{0}, request_count))
+    {
+        std::vector<uint8_t> header(core::frame_header_size);
+        boost::asio::read(socket, boost::asio::buffer(header));
+        size_t offset = 0;
+        std::vector<uint8_t> body(core::get_integer<uint32_t>(header, offset).value());
+        boost::asio::read(socket, boost::asio::buffer(body));
+    }
+    ASSERT_EQ(handled, request_count);
+
+    socket.close();
+    server.join();
+}
+
+TEST(Exchange, LedgerCompaction_Test)
+{
+    std::filesystem::remove("test_archive.db");
+
+    SQLite::Database test_db("test.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+
+    for (auto const table : {"wallets", "transactions", "balances", "compactions"})
+    {
+        test_db.exec(fmt::format("DROP TABLE IF EXISTS {}", table));
+    }
+
+    auto const balances = [](modules::Wallet& wallet, uint64_t const user_id) {
+        auto const wallet_infos = wallet.wallets(user_id);
+        std::vector<std::pair<std::string, int64_t>> balances;
+        for (auto const& wallet_info : wallet_infos.value())
+        {
+            balances.emplace_back(wallet_info.currency, wallet_info.amount);
+        }
+        std::sort(balances.begin(), balances.end());
+        return balances;
+    };
+    auto const count = [](SQLite::Database& database, std::string_view const query) {
+        SQLite::Statement statement(database, std::string(query));
+        return statement.executeStep() ? statement.getColumn(0).getInt64() : int64_t(-1);
+    };
+
+    std::vector<std::pair<std::string, int64_t>> expected_balances;
+    {
+        modules::Wallet wallet(test_db, std::nullopt);
+
+        uint64_t RUB_wallet_id;
+        uint64_t USD_wallet_id;
+        ASSERT_TRUE(wallet.create_wallet(1, "RUB", RUB_wallet_id));
+        ASSERT_TRUE(wallet.create_wallet(1, "USD", USD_wallet_id));
+
+        for (int64_t const i : std::views::iota(1, 21))
+        {
+            ASSERT_TRUE(
+                wallet.make_transaction(RUB_wallet_id, 100 * i, modules::WalletTransactionType::Deposit, "Deposit"));
+            ASSERT_TRUE(
+                wallet.make_transaction(USD_wallet_id, 10 * i, modules::WalletTransactionType::Deposit, "Deposit"));
+            ASSERT_TRUE(
+                wallet.make_transaction(RUB_wallet_id, 30 * i, modules::WalletTransactionType::Withdraw, "Withdraw"));
+        }
+        expected_balances = balances(wallet, 1);
+    }
+    ASSERT_EQ(count(test_db, "SELECT COUNT(*) FROM transactions"), 60);
+
+    {
+        modules::SQLiteBackend const storage(modules::StorageSettings{.path = "test.db"}, std::nullopt);
+        modules::CompactionSettings const settings{.archive_path = "test_archive.db",
+                                                   .interval = std::chrono::seconds::zero(),
+                                                   .retained_transactions = 10,
+                                                   .batch_size = 16};
+        modules::LedgerCompactor compactor(storage, settings, std::nullopt);
+
+        // 50 rows are old enough, so it takes four batches
+        for (int32_t i = 0; i < 4; ++i)
+        {
+            ASSERT_TRUE(compactor.compact());
+        }
+        ASSERT_FALSE(compactor.compact());
+    }
+
+    // The recent rows stay, each wallet keeps a single checkpoint for everything before them
+    ASSERT_EQ(count(test_db, "SELECT COUNT(*) FROM transactions WHERE id > 50"), 10);
+    ASSERT_EQ(count(test_db, "SELECT COUNT(*) FROM transactions WHERE id <= 50"), 2);
+    ASSERT_EQ(count(test_db, "SELECT COUNT(*) FROM transactions WHERE description = 'Checkpoint'"), 2);
+    ASSERT_EQ(count(test_db, "SELECT transaction_id FROM compactions WHERE ledger = 'transactions'"), 50);
+
+    {
+        SQLite::Database archive_db("test_archive.db", SQLite::OPEN_READONLY);
+        ASSERT_EQ(count(archive_db, "SELECT COUNT(*) FROM transactions"), 50);
+        ASSERT_EQ(count(archive_db, "SELECT SUM(amount) FROM transactions WHERE id <= 3"), 140);
+    }
+
+    // Balances are the same whether they are kept or rebuilt from the compacted ledger
+    {
+        modules::Wallet wallet(test_db, std::nullopt);
+        ASSERT_EQ(balances(wallet, 1), expected_balances);
+    }
+    test_db.exec("DROP TABLE balances");
+    {
+        modules::Wallet wallet(test_db, std::nullopt);
+        ASSERT_EQ(balances(wallet, 1), expected_balances);
+    }
+
+    std::filesystem::remove("test_archive.db");
 }
 
 auto main(int32_t argc, char** argv) -> int32_t
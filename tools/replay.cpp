@@ -0,0 +1,271 @@
+#include "modules/exchange.hpp"
+#include "modules/wallet.hpp"
+#include "precompiled.hpp"
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <argh.h>
+
+using namespace exchange;
+
+// Recorded request, one per line: timestamp,user_id,instrument,side,amount,price
+struct OrderEvent
+{
+    uint64_t timestamp;
+    uint64_t user_id;
+    core::InstrumentId instrument;
+    modules::RequestType request_type;
+    int64_t amount;
+    int64_t price;
+};
+
+// FNV-1a, so the digest does not depend on the platform or the standard library
+class Digest
+{
+  public:
+    auto update(std::span<uint8_t const> const bytes) -> void
+    {
+        for (uint8_t const byte : bytes)
+        {
+            m_value = (m_value ^ byte) * 0x100000001b3;
+        }
+    }
+
+    auto update(int64_t const value) -> void
+    {
+        std::array<uint8_t, sizeof(value)> bytes;
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8));
+        }
+        this->update(bytes);
+    }
+
+    auto update(std::string_view const value) -> void
+    {
+        this->update(static_cast<int64_t>(value.size()));
+        this->update(std::span(reinterpret_cast<uint8_t const*>(value.data()), value.size()));
+    }
+
+    auto value() const -> uint64_t
+    {
+        return m_value;
+    }
+
+  private:
+    uint64_t m_value = 0xcbf29ce484222325;
+};
+
+auto parse_event(std::string_view const line, OrderEvent& event) -> bool
+{
+    std::vector<std::string> fields;
+    boost::split(fields, line, boost::is_any_of(","));
+    if (fields.size() != 6)
+    {
+        return false;
+    }
+
+    for (auto& field : fields)
+    {
+        boost::trim(field);
+    }
+
+    auto const instrument = core::find_instrument(fields[2]);
+    if (!instrument)
+    {
+        return false;
+    }
+
+    if (boost::iequals(fields[3], "buy"))
+    {
+        event.request_type = modules::RequestType::Buy;
+    }
+    else if (boost::iequals(fields[3], "sell"))
+    {
+        event.request_type = modules::RequestType::Sell;
+    }
+    else
+    {
+        return false;
+    }
+
+    auto const amount = core::Decimal::parse(fields[4], instrument->amount_scale);
+    auto const price = core::Decimal::parse(fields[5], instrument->price_scale);
+    if (!amount || !price)
+    {
+        return false;
+    }
+
+    try
+    {
+        event.timestamp = std::stoull(fields[0]);
+        event.user_id = std::stoull(fields[1]);
+    }
+    catch (std::exception const&)
+    {
+        return false;
+    }
+
+    event.instrument = instrument->id;
+    event.amount = amount->units();
+    event.price = price->units();
+    return true;
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    argh::parser command_line(argc, argv, argh::parser::PREFER_PARAM_FOR_UNREG_OPTION);
+
+    std::string input_path;
+    if (!(command_line({"-i", "--input"}) >> input_path))
+    {
+        std::cerr << "Usage: exchange_replay -i <order log> [-d <database>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string database_path;
+    if (!(command_line({"-d", "--database"}) >> database_path))
+    {
+        database_path = "replay.db";
+    }
+
+    spdlog::set_level(spdlog::level::info);
+
+    std::vector<OrderEvent> events;
+    {
+        std::ifstream input(input_path);
+        if (!input)
+        {
+            spdlog::error("Cannot open {}", input_path);
+            return EXIT_FAILURE;
+        }
+
+        std::string line;
+        for (uint64_t line_number = 1; std::getline(input, line); ++line_number)
+        {
+            boost::trim(line);
+            if (line.empty() || line.starts_with('#'))
+            {
+                continue;
+            }
+
+            OrderEvent event;
+            if (!parse_event(line, event))
+            {
+                spdlog::error("Malformed event at {}:{}", input_path, line_number);
+                return EXIT_FAILURE;
+            }
+            events.emplace_back(event);
+        }
+    }
+
+    // Requests recorded at the same time keep the order they were logged in
+    std::stable_sort(events.begin(), events.end(),
+                     [](auto const& lhs, auto const& rhs) { return lhs.timestamp < rhs.timestamp; });
+
+    try
+    {
+        // Ids are part of the digest, so every replay starts from empty tables
+        SQLite::Database database(database_path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        database.exec("DROP TABLE IF EXISTS requests");
+        database.exec("DROP TABLE IF EXISTS wallets");
+        database.exec("DROP TABLE IF EXISTS transactions");
+
+        modules::Exchange exchange(database, std::nullopt);
+        modules::Wallet wallet(database, std::nullopt);
+
+        std::set<uint64_t> users;
+        for (auto const& event : events)
+        {
+            users.insert(event.user_id);
+        }
+
+        for (uint64_t const user_id : users)
+        {
+            for (auto const& currency : core::currencies)
+            {
+                uint64_t new_wallet_id;
+                if (!wallet.create_wallet(user_id, currency.name, new_wallet_id))
+                {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        std::vector<double> latencies;
+        latencies.reserve(events.size());
+
+        auto const started = std::chrono::steady_clock::now();
+        for (auto const& event : events)
+        {
+            auto const submitted = std::chrono::steady_clock::now();
+            if (!exchange.make_request(event.user_id, event.instrument, event.amount, event.price,
+                                       event.request_type))
+            {
+                spdlog::error("Request of user {} at {} was rejected", event.user_id, event.timestamp);
+                return EXIT_FAILURE;
+            }
+            exchange.process_requests(wallet);
+            latencies.emplace_back(
+                std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count());
+        }
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - started;
+
+        // Fills, resting requests and balances, all in a stable order
+        Digest digest;
+        uint64_t fills = 0;
+        {
+            SQLite::Statement statement(database, "SELECT wallets.user_id, wallets.currency, amount, "
+                                                  "transaction_type FROM transactions INNER JOIN wallets ON "
+                                                  "transactions.wallet_id = wallets.id ORDER BY transactions.id");
+            while (statement.executeStep())
+            {
+                digest.update(statement.getColumn(0).getInt64());
+                digest.update(statement.getColumn(1).getString());
+                digest.update(statement.getColumn(2).getInt64());
+                digest.update(statement.getColumn(3).getInt64());
+                ++fills;
+            }
+        }
+        {
+            SQLite::Statement statement(database, "SELECT user_id, currency, amount, price, request_type "
+                                                  "FROM requests ORDER BY id");
+            while (statement.executeStep())
+            {
+                digest.update(statement.getColumn(0).getInt64());
+                digest.update(statement.getColumn(1).getString());
+                digest.update(statement.getColumn(2).getInt64());
+                digest.update(statement.getColumn(3).getInt64());
+                digest.update(statement.getColumn(4).getInt64());
+            }
+        }
+        for (uint64_t const user_id : users)
+        {
+            auto wallets = wallet.wallets(user_id).value_or(std::vector<modules::WalletInfo>{});
+            std::sort(wallets.begin(), wallets.end(),
+                      [](auto const& lhs, auto const& rhs) { return lhs.currency < rhs.currency; });
+            for (auto const& wallet_info : wallets)
+            {
+                digest.update(static_cast<int64_t>(user_id));
+                digest.update(wallet_info.currency);
+                digest.update(wallet_info.amount);
+            }
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto const percentile = [&](double const quantile) -> double {
+            return latencies.empty() ? 0.0 : latencies[static_cast<size_t>(quantile * (latencies.size() - 1))];
+        };
+
+        spdlog::info("Replayed {} requests of {} users in {:.3f} s ({:.0f} orders/s)", events.size(), users.size(),
+                     elapsed.count(), events.size() / std::max(elapsed.count(), 1e-9));
+        spdlog::info("Latency p50 {:.1f} us, p99 {:.1f} us, max {:.1f} us", percentile(0.5), percentile(0.99),
+                     percentile(1.0));
+        spdlog::info("Wallet transactions: {}", fills);
+        spdlog::info("Digest: {:016x}", digest.value());
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}